@@ -20,7 +20,17 @@
 
 #include <stdbool.h>
 
+// sys/types.h: needed for "ssize_t", returned by rs_reader_fn routines
+
+#include <sys/types.h>
+
+// stdint.h: needed for "uint64_t", the rs_hash64() line hash type
+
+#include <stdint.h>
+
 typedef struct RAWSCAN RAWSCAN; // support opaque pointers to RAWSCAN structs
+typedef struct RAWSCAN_BULK RAWSCAN_BULK;   // ditto, for rs_bulk_*() state
+typedef struct RAWSCAN_MERGE RAWSCAN_MERGE; // ditto, for rs_merge_*() state
 
 // Enumerate the various kinds of RAWSCAN_RESULT's that rs_getline returns.
 
@@ -63,12 +73,393 @@ func_static RAWSCAN *rs_open (
   char delimiterbyte   // newline '\n' or other byte marking end of "lines"
 );
 
+// Caller supplied input routine, used in place of read(2) on a file
+// descriptor.  Same contract as read(2): return count of bytes put
+// in buf (at most count), 0 at end of input, or -1 with errno set.
+
+typedef ssize_t (*rs_reader_fn)(void *arg, void *buf, size_t count);
+
+func_static RAWSCAN *rs_open_reader (
+  rs_reader_fn reader, // call reader(arg, buf, count) to obtain more input
+  void *arg,           // passed unchanged to each reader() call
+  size_t bufsz,        // main input buffer size
+  char delimiterbyte   // newline '\n' or other byte marking end of "lines"
+);
+
+// Read multi-frame BGZF or zstd compressed input from fd, decompressing
+// frames in parallel on nthreads threads (<= 0: one per online cpu).
+// Other gzip input is inflated serially.  Input that is not compressed
+// is passed through unchanged.
+
+func_static RAWSCAN *rs_open_zframes (
+  int fd,              // read compressed input from this file descriptor
+  size_t bufsz,        // main input buffer size
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  int nthreads         // number of decompression threads
+);
+
+// Read the files named in paths[0 .. npaths-1], in order, as one
+// stream, like cat(1), except that a file's last line always ends
+// at the end of that file, even if it lacks a final delimiterbyte.
+// The paths are copied; they needn't outlive rs_open_files().
+
+func_static RAWSCAN *rs_open_files (
+  const char *const paths[], // files to read, in order
+  size_t npaths,             // how many paths
+  size_t bufsz,              // main input buffer size
+  char delimiterbyte         // newline '\n' or other byte marking end of "lines"
+);
+
+// Index in paths[] of the file that the last returned line came from.
+func_static size_t rs_get_file_index(RAWSCAN *rsp);
+
+// Called by rs_dirscan() worker threads, concurrently, with the
+// first (or only) chunk of each line; return true if it matches.
+
+typedef bool (*rs_line_match_fn)(void *arg, const char *begin, const char *end);
+
+// Scan every regular file in the directory trees under roots[],
+// in parallel on nthreads threads (<= 0: one per online cpu),
+// writing each line that match() accepts, as "path:line", to outfd.
+// Returns count of matching lines, or -1 if couldn't get started.
+
+func_static long rs_dirscan (
+  const char *const roots[], // directories (or files) to scan
+  size_t nroots,             // how many roots
+  int nthreads,              // number of scanning threads
+  size_t bufsz,              // main input buffer size, per thread
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  rs_line_match_fn match,    // select lines to output
+  void *arg,                 // passed unchanged to each match() call
+  int outfd                  // write matching lines here
+);
+
+// Flags for rs_open_flags():
+
+#define RS_OPEN_COMPACT  0x1   // share memory pages with other streams
+#define RS_OPEN_PREFAULT 0x2   // fault in all buffer pages during open
+#define RS_OPEN_MLOCK    0x4   // lock buffer in memory (implies PREFAULT)
+
+func_static RAWSCAN *rs_open_flags (
+  int fd,              // read input from this (already open) file descriptor
+  size_t bufsz,        // main input buffer size
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  unsigned flags       // RS_OPEN_* flags, or'd together
+);
+
 func_static void rs_close(RAWSCAN *rsp);
+func_static void rs_reopen(RAWSCAN *rsp, int fd);
 func_static void rs_enable_pause(RAWSCAN *rsp);
 func_static void rs_disable_pause(RAWSCAN *rsp);
 func_static void rs_resume_from_pause(RAWSCAN *rsp);
+func_static void rs_release_upto(RAWSCAN *rsp, const char *ptr);
+func_static size_t rs_get_shift_total(RAWSCAN *rsp);
 func_static RAWSCAN_RESULT rs_getline (RAWSCAN *rsp);
+func_static RAWSCAN_RESULT rs_peekline (RAWSCAN *rsp);
+func_static RAWSCAN_RESULT rs_getline_hashed (RAWSCAN *rsp, uint64_t *hash);
+func_static uint64_t rs_hash64(const char *p, size_t len);
+
+// Bulk open and read of many (small) files, using io_uring where
+// available.  rs_bulk_next() returns a stream, with its first bufsz
+// bytes already read, for each path in turn, in the order that the
+// reads complete, or NULL once all have been returned.  Each stream
+// returned is only valid until the next rs_bulk_next() call.
+
+func_static RAWSCAN_BULK *rs_bulk_open (
+  const char *const paths[], // files to read
+  size_t npaths,             // how many paths
+  size_t bufsz,              // main input buffer size, per stream
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  unsigned depth             // how many files in flight at once (0: default)
+);
+func_static RAWSCAN *rs_bulk_next(RAWSCAN_BULK *bp);
+func_static size_t rs_bulk_file_index(RAWSCAN_BULK *bp);
+func_static void rs_bulk_close(RAWSCAN_BULK *bp);
+
+// A JSON Lines record, with the offset from begin of each structural
+// character in it: '{', '}', '[', ']', ':' and ',' outside strings,
+// and each '"' opening or closing a string.
+
+typedef struct {
+    const char *begin;             // ptr to first byte in record
+    const char *end;               // ptr to last byte in record
+    const uint32_t *structurals;   // offsets of structural characters
+    size_t nstructurals;           // how many structurals
+    bool unclosed;                 // input ended within a string
+} RAWSCAN_JSON;
+
+func_static RAWSCAN_RESULT rs_getline_json (RAWSCAN *rsp, RAWSCAN_JSON *jp);
+
+// Project JSONL records onto a few key paths, such as "user.id":
+// rs_json_project() sets values[i] to the span of the value of paths[i]
+// in a record from rs_getline_json() (NULL begin and end if absent),
+// and returns count found.  rs_getline_projected() returns the next
+// record having all the paths flagged in required, with its values.
+
+typedef struct RAWSCAN_JSONPATHS RAWSCAN_JSONPATHS;
+
+typedef struct {
+    const char *begin;             // ptr to first byte of value
+    const char *end;               // ptr to last byte of value
+} RAWSCAN_SPAN;
+
+func_static RAWSCAN_JSONPATHS *rs_json_paths_open (
+  const char *const paths[], // key paths, components separated by '.'
+  size_t npaths,             // how many paths (at most 64)
+  uint64_t required          // bit i set: skip records lacking paths[i]
+);
+func_static void rs_json_paths_close(RAWSCAN_JSONPATHS *pp);
+func_static size_t rs_json_project(const RAWSCAN_JSON *jp,
+                        const RAWSCAN_JSONPATHS *pp, RAWSCAN_SPAN values[]);
+func_static RAWSCAN_RESULT rs_getline_projected(RAWSCAN *rsp,
+        const RAWSCAN_JSONPATHS *pp, RAWSCAN_JSON *jp, RAWSCAN_SPAN values[]);
+
+// Split a logfmt line (key=value key2="quoted value" flag ...) into
+// key and value spans; returns count of pairs, setting the first
+// maxkvs of them in kvs[].  A bare flag key has a NULL value.
+
+typedef struct {
+    RAWSCAN_SPAN key;
+    RAWSCAN_SPAN value;            // quoted: excludes quotes; flag: NULL
+} RAWSCAN_KV;
+
+func_static size_t rs_logfmt_parse(const char *p, size_t len,
+                                   RAWSCAN_KV kvs[], size_t maxkvs);
+
+// Split an RFC 5424 syslog line into its fields; 0, or -1 if not one.
+
+typedef struct {
+    int priority;                  // facility * 8 + severity
+    int version;
+    int64_t time_ns;               // timestamp, ns since Unix epoch
+    RAWSCAN_SPAN timestamp;        // fields as spans; "-" if NILVALUE
+    RAWSCAN_SPAN hostname;
+    RAWSCAN_SPAN appname;
+    RAWSCAN_SPAN procid;
+    RAWSCAN_SPAN msgid;
+    RAWSCAN_SPAN structured_data;
+    RAWSCAN_SPAN msg;              // NULL begin and end if no MSG
+} RAWSCAN_SYSLOG;
+
+func_static int rs_syslog_parse(const char *p, size_t len, RAWSCAN_SYSLOG *sp);
+
+// Parse fields of up to maxrows lines into typed column arrays, one
+// value per row per column; sets *nrows to rows filled.  Returns the
+// last line's result, or the rt_eof, rt_err or rt_paused ending it
+// (rt_err, EINVAL, if maxrows is 0).
+
+enum rs_coltype {
+    rs_col_int64,          // int64_t, decimal with optional sign
+    rs_col_double,         // double, as strtod() would parse
+    rs_col_time,           // int64_t ns since epoch, from RFC 3339 or
+                           //   "YYYY-MM-DD HH:MM:SS[.frac]" (UTC)
+};
+
+typedef struct {
+    int field;             // parse this field of each line (0: first)
+    enum rs_coltype type;  // as this type
+    void *values;          // into this int64_t or double array [maxrows]
+    uint8_t *valid;        // 1 if parsed, else 0 (value 0 or NaN) (or NULL)
+} RAWSCAN_COLUMN;
+
+func_static RAWSCAN_RESULT rs_getcolumns(RAWSCAN *rsp, char fieldsep,
+        const RAWSCAN_COLUMN cols[], size_t ncols, size_t maxrows,
+        size_t *nrows);
+
+// Apache Arrow C Data Interface structs, as its specification gives them.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    // Array type description
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowSchema *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+struct ArrowArray {
+    // Array data description
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+
+    // Release callback
+    void (*release)(struct ArrowArray *);
+    // Opaque producer-specific data
+    void *private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// Copy up to maxrows lines (and about maxbytes of data) into an Arrow
+// string array, long lines as nulls; release with out->release(out).
+// Returns the last line's result, or the rt_eof, rt_err or rt_paused
+// ending the batch (rt_err, EINVAL, if maxrows is 0).  rs_arrow_schema()
+// describes such arrays.
+
+enum rs_arrow_type {
+    rs_arrow_utf8,         // "u": int32 offsets
+    rs_arrow_large_utf8,   // "U": int64 offsets
+    rs_arrow_binary,       // "z": int32 offsets, no UTF-8 claim
+    rs_arrow_large_binary, // "Z": int64 offsets, no UTF-8 claim
+};
+
+func_static RAWSCAN_RESULT rs_getarrow(RAWSCAN *rsp, enum rs_arrow_type type,
+        size_t maxrows, size_t maxbytes, struct ArrowArray *out);
+func_static int rs_arrow_schema(enum rs_arrow_type type, const char *name,
+        struct ArrowSchema *out);
+
 func_static int rs_set_min1stchunklen(RAWSCAN *rsp, size_t min1stchunklen);
 func_static size_t rs_get_min1stchunklen(RAWSCAN *rsp);
 
+// Cap each read to at most max_readlen bytes, so freshly read data
+// is scanned while still in cache (default: the buffer size).
+
+func_static int rs_set_max_readlen(RAWSCAN *rsp, size_t max_readlen);
+func_static size_t rs_get_max_readlen(RAWSCAN *rsp);
+
+// Rewrite each byte b read into rsp's buffer as map[b], before lines
+// are found (NULL map: stop).  Fails with EBUSY on changing the map
+// while bytes read through the old one remain.  rs_transform_map()
+// sets map to the identity, plus the RS_XFORM_* changes, for further
+// tr style edits.
+
+#define RS_XFORM_TOLOWER      0x1   // ASCII 'A' .. 'Z' to 'a' .. 'z'
+#define RS_XFORM_TOUPPER      0x2   // ASCII 'a' .. 'z' to 'A' .. 'Z'
+#define RS_XFORM_NUL_TO_SPACE 0x4   // '\0' to ' '
+
+func_static void rs_transform_map(unsigned char map[256], unsigned flags);
+func_static int rs_set_transform(RAWSCAN *rsp, const unsigned char *map);
+
+// Literal line filter, for rs_getline_filtered(), which returns only
+// the lines holding it, setting *match to its span in the line.
+
+typedef struct RAWSCAN_FILTER RAWSCAN_FILTER;
+
+#define RS_FILTER_NOCASE 0x1        // ignore ASCII case
+#define RS_FILTER_PREFIX 0x2        // match only at start of line
+
+func_static RAWSCAN_FILTER *rs_filter_open(const char *literal, size_t len,
+                                           unsigned flags);
+func_static void rs_filter_close(RAWSCAN_FILTER *fp);
+func_static RAWSCAN_RESULT rs_getline_filtered(RAWSCAN *rsp,
+        const RAWSCAN_FILTER *fp, RAWSCAN_SPAN *match);
+
+// Order lines a (alen bytes) and b (blen bytes), excluding their
+// delimiterbytes: return < 0, 0, or > 0, like memcmp().
+
+typedef int (*rs_line_cmp_fn)(void *arg, const char *a, size_t alen,
+                                         const char *b, size_t blen);
+
+// Merge streams over sorted input, like "sort -m".  rs_merge_next()
+// returns the lines of all streams, in order, one per call, each
+// valid until the next call, then rt_eof.
+
+func_static RAWSCAN_MERGE *rs_merge_open (
+  RAWSCAN *const rsps[],     // sorted input streams
+  size_t nrsps,              // how many streams
+  rs_line_cmp_fn cmp,        // line order, or NULL for byte-wise order
+  void *arg                  // passed unchanged to each cmp() call
+);
+func_static RAWSCAN_RESULT rs_merge_next(RAWSCAN_MERGE *mp);
+func_static size_t rs_merge_stream_index(RAWSCAN_MERGE *mp);
+func_static void rs_merge_close(RAWSCAN_MERGE *mp);
+
+// Sort the lines read from infd, byte-wise, to outfd, using about
+// memsz bytes (0: default) for lines in memory, spilling sorted runs
+// to temporary files in tmpdir (NULL: $TMPDIR or /tmp) and merging
+// them if need be, sorting on nthreads threads (<= 0: one per cpu).
+// Returns count of lines sorted, or -1, with errno set, on failure.
+
+func_static long rs_sort (
+  int infd,            // read lines to sort from this file descriptor
+  int outfd,           // write sorted lines here
+  size_t bufsz,        // rawscan input buffer size, per stream
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  size_t memsz,        // memory for lines being sorted (0: default)
+  int nthreads,        // number of sorting threads (<= 0: ncpus)
+  const char *tmpdir   // directory for temporary files (NULL: $TMPDIR, /tmp)
+);
+
+// Copy lines from infd to outfd, less duplicates: all those after
+// the first (rs_dedup_global, like "sort -u", but in input order),
+// or those same as the line just before (rs_dedup_adjacent, like
+// uniq).  rs_dedup_global keeps distinct lines in about memsz bytes
+// (0: default), spilling to temporary files in tmpdir if need be.
+// Returns count of lines output, or -1, with errno set, on failure.
+
+enum rs_dedup_mode {
+    rs_dedup_global,       // drop every repeat of a line seen before
+    rs_dedup_adjacent,     // drop repeats of just the previous line
+};
+
+func_static long rs_dedup (
+  int infd,            // read lines from this file descriptor
+  int outfd,           // write lines, less duplicates, here
+  size_t bufsz,        // rawscan input buffer size, per stream
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  enum rs_dedup_mode mode,  // rs_dedup_global or rs_dedup_adjacent
+  size_t memsz,        // global: memory for distinct lines (0: default)
+  const char *tmpdir   // global: directory for spill files (NULL: $TMPDIR, /tmp)
+);
+
+// Which part of each line rs_partition() hashes to pick its output.
+
+typedef struct {
+    int field;             // key is this field (0: first), or < 0: byte range
+    char fieldsep;         // field: fields are separated by this byte
+    size_t offset;         // byte range: starts this many bytes into line
+    size_t length;         // byte range: this many bytes (0: rest of line)
+} RAWSCAN_KEYSPEC;
+
+// Shard lines from infd across outfds[0 .. nout-1], by rs_hash64()
+// of each line's key, staging lines per output, flushed by writev().
+// Returns count of lines sharded, or -1, with errno set, on failure.
+
+func_static long rs_partition (
+  int infd,                  // read lines to shard from this file descriptor
+  const int outfds[],        // write each line to one of these
+  size_t nout,               // how many outfds
+  size_t bufsz,              // rawscan input buffer size
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  const RAWSCAN_KEYSPEC *key // which part of each line to hash
+);
+
+// Split regular file infd, from its current offset, into pieces of
+// nlines lines, or of at most nbytes bytes of whole lines, as "split
+// -l" or "split -C" would, moving the data with copy_file_range(2).
+// Each piece goes to open_piece(arg, i), closed once written.
+// Returns count of pieces, or -1, with errno set, on failure.
+
+typedef int (*rs_split_open_fn)(void *arg, size_t i);
+
+func_static long rs_split (
+  int infd,                  // split this file, from its current offset
+  size_t nlines,             // lines per piece, or 0
+  size_t nbytes,             // or, at most this many bytes per piece, or 0
+  size_t bufsz,              // rawscan input buffer size, for nlines
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  rs_split_open_fn open_piece, // returns file descriptor for each piece
+  void *arg                  // passed unchanged to each open_piece() call
+);
+
 #endif /* _RAWSCAN_H */
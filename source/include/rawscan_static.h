@@ -44,13 +44,17 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <stddef.h>
 
@@ -60,8 +64,54 @@
 
  /* Need glibc Feature Test Macro __USE_MISC to pick up sbrk(), brk() */
 #define __USE_MISC
+ /* ... and __USE_XOPEN2K8 to pick up pread(), used by rs_split() */
+#define __USE_XOPEN2K8
 #include <unistd.h>
 
+// Optional decompression libraries used by rs_open_zframes().  The
+// cmake build defines these to 1 when it finds the library installed.
+
+#ifndef RAWSCAN_WITH_ZLIB
+#define RAWSCAN_WITH_ZLIB 0
+#endif
+
+#ifndef RAWSCAN_WITH_ZSTD
+#define RAWSCAN_WITH_ZSTD 0
+#endif
+
+#if RAWSCAN_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#if RAWSCAN_WITH_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+// rs_bulk_*() use io_uring, through its raw system calls, if the
+// kernel headers define it.  Otherwise, or if the running kernel
+// won't set up a ring, or predates its openat (Linux 5.6), they fall
+// back to plain open/read/close.
+
+#ifndef RAWSCAN_WITH_IO_URING
+#if defined(__has_include) && __has_include(<linux/io_uring.h>)
+#define RAWSCAN_WITH_IO_URING 1
+#else
+#define RAWSCAN_WITH_IO_URING 0
+#endif
+#endif
+
+#if RAWSCAN_WITH_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+// rs_getline_json() compares 32 or 16 bytes at a time, with AVX2 or
+// SSE2, where the compiler targets those, else one byte at a time.
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 // cmake debug builds enable asserts (NDEBUG not defined),
 // whereas cmake release builds define NDEBUG to disable asserts.
 #include <assert.h>
@@ -286,6 +336,21 @@
  * would have no dependency on any librawscan.so dynamic library.
  */
 
+struct rawscan_files;        // rs_open_files() state, defined below
+struct rawscan_json;         // rs_getline_json() state, defined below
+
+// rawscan_hash64() of a line taken in pieces, as rs_getline_hashed()
+// takes a long line, a chunk at a time: the 16 byte steps done so
+// far, and the last 1 to 16 bytes, held back in case they're the
+// last, which rawscan_hash64() treats differently.
+
+struct rawscan_hash_state {
+    uint64_t h;             // hash of the 16 byte steps taken so far
+    size_t len;             // bytes added so far
+    char tail[16];          // the last ntail of them, not yet in h
+    size_t ntail;
+};
+
 typedef struct RAWSCAN {
     const char *buf;        // bufsz buffer
     const char *buftop;     // l.u.b. of buf; put read-only delimiterbyte here
@@ -293,10 +358,27 @@ typedef struct RAWSCAN {
 
     int fd;                 // open file descriptor to read rawscan input from
     int errnum;             // stashed errno from failed system calls
+    unsigned flags;         // RS_OPEN_* flags from rs_open_flags()
+
+    // If reader is set, rawscan_read() calls it instead of read(2).
+    // If closer is set, rs_close() calls it to release reader_arg.
+
+    rs_reader_fn reader;    // caller supplied input routine, or NULL
+    void *reader_arg;       // passed to reader() and closer()
+    void (*closer)(void *reader_arg);
+
+    // If files is set, then at the end of each file, rs_getline()
+    // moves on to the next of the rs_open_files() paths.
+
+    struct rawscan_files *files;
+    struct rawscan_json *json;  // rs_getline_json() state, if used
+    struct rawscan_xform *xform; // rs_set_transform() byte map, if set
+    struct RAWSCAN *pool_next;  // next in rawscan_pool, while in it
 
     size_t pgsz;            // hardware memory page size
     size_t bufsz;           // main input buffer size
     size_t min1stchunklen;  // guaranteed min len of first chunk of long line
+    size_t max_readlen;     // most bytes to ask for in any one read
 
     // When rs_getline() calls a subroutine to return the next
     // line or chunk (part of a line too long to fit in buffer)
@@ -313,6 +395,35 @@ typedef struct RAWSCAN {
 
     const char *next_delim_ptr_peek;
 
+    // Set by rs_release_upto(): bytes below release_mark are no
+    // longer needed by the caller, bytes from there up to p are.
+
+    const char *release_mark;
+    size_t shift_total;     // total distance retained data was moved down
+
+    // Set by rs_peekline(): rsp->result holds the next result to
+    // return, and next_delim_ptr_peek is parked at buftop, to send
+    // the next rs_getline() to rs_getline_morecode() to return it.
+
+    bool peeked;
+    const char *peeked_delim_ptr_peek;   // restore to next_delim_ptr_peek
+    const char *peeked_p;   // p before the peek: just past data returned
+
+    struct rawscan_hash_state longline_hash;    // rs_getline_hashed()
+
+    // rawscan_read() calls so far.  Data in the buffer only moves just
+    // before such a call, so pointers saved at the same count are good.
+    // rs_getline_filtered() saves where it has searched, and found.
+
+    unsigned long nfills;
+    struct {
+        const struct RAWSCAN_FILTER *fp;    // literal searched for
+        unsigned long nfills;               // when searched
+        const char *end;                    // searched up to here,
+        const char *match;                  // first match, or NULL
+        bool inlong;                        // in a matching long line
+    } filt;
+
     RAWSCAN_RESULT result;  // rs_getline() returns a copy of this result
 
     char delimiterbyte;     // byte @ end of "lines" (e.g. '\n' or '\0')
@@ -362,10 +473,129 @@ typedef struct RAWSCAN {
 //     line, which is equivalent to (1) if min1stchunklen has its
 //     default bufsiz value.
 
+/*
+ * Compact mode (rs_open_flags() with RS_OPEN_COMPACT):
+ *
+ * The above layout costs at least three pages per stream: a page
+ * for a RAWSCAN structure of a couple hundred bytes, the buffer
+ * pages, and a whole read-only page for one sentinel byte.  For a
+ * program with ten thousand streams open at once, each with a 4 KByte
+ * buffer, that's some 120 MBytes, two thirds of it wasted.
+ *
+ * So in compact mode, RAWSCAN structures are carved, RAWSCAN_SLAB_COUNT
+ * at a time, out of a shared slab, and buffers are carved out of a
+ * shared arena, both of which grow RAWSCAN_ARENA_CHUNK bytes at a
+ * time using sbrk(2).  Each buffer is followed immediately by its
+ * sentinel delimiterbyte and a guard rail nul, in the same writable
+ * memory.  The same ten thousand streams then cost about 44 MBytes.
+ *
+ * The price is that the sentinel is no longer protected from stray
+ * writes.  rawscan itself never writes at or above buftop, and
+ * rewrites the sentinel before each read in compact mode, but a
+ * caller writing past the end of a returned line could still corrupt
+ * it before the next rs_getline(), sending rawmemchr() into the next
+ * stream's memory.  Well behaved callers are unaffected.
+ */
+
+#ifndef RAWSCAN_ARENA_CHUNK
+#define RAWSCAN_ARENA_CHUNK (1024*1024)
+#endif
+
+#ifndef RAWSCAN_SLAB_COUNT
+#define RAWSCAN_SLAB_COUNT 64
+#endif
+
+static struct rawscan_compact_arena {
+    char *next, *end;           // unused arena memory [next, end)
+    RAWSCAN *slab;              // next free RAWSCAN in current slab
+    unsigned slab_free;         // how many free RAWSCANs left in slab
+} rawscan_compact_arena;
+
+static void *rawscan_arena_alloc(size_t size, size_t align)
+{
+    struct rawscan_compact_arena *a = &rawscan_compact_arena;
+    char *p = (char *)(((uintptr_t)a->next + align - 1) & ~(align - 1));
+
+    if (a->next == NULL || p + size > a->end) {
+        size_t pgsz = sysconf(_SC_PAGESIZE);
+        size_t chunk = size + align > RAWSCAN_ARENA_CHUNK ?
+                                size + align : RAWSCAN_ARENA_CHUNK;
+        void *old_sbrk;
+
+        // Whole pages, keeping the break page aligned, as the
+        // rs_open() of a stream that isn't compact requires.
+        chunk = (chunk + pgsz - 1) / pgsz * pgsz;
+        if ((old_sbrk = sbrk(chunk)) == (void *)-1)
+            return NULL;
+        a->next = old_sbrk;
+        a->end = (char *)old_sbrk + chunk;
+        p = (char *)(((uintptr_t)a->next + align - 1) & ~(align - 1));
+    }
+    a->next = p + size;
+    return p;
+}
+
+static RAWSCAN *rawscan_slab_alloc(void)
+{
+    struct rawscan_compact_arena *a = &rawscan_compact_arena;
+
+    if (a->slab_free == 0) {
+        a->slab = rawscan_arena_alloc(RAWSCAN_SLAB_COUNT * sizeof(RAWSCAN),
+                                                    _Alignof(RAWSCAN));
+        if (a->slab == NULL)
+            return NULL;
+        a->slab_free = RAWSCAN_SLAB_COUNT;
+    }
+    a->slab_free--;
+    return a->slab++;
+}
+
+/*
+ * RS_OPEN_PREFAULT and RS_OPEN_MLOCK:
+ *
+ * Pages freshly added to the data segment by brk(2) aren't really
+ * there until first touched, so the first pass through a new buffer
+ * takes a minor page fault every page (which compare_various_apis.sh
+ * shows, in its "minorpagefaults" column, for short runs).  With
+ * RS_OPEN_PREFAULT, rs_open_flags() takes those faults itself, by
+ * writing a byte to each buffer page, so that a latency sensitive
+ * caller doesn't take them later, while scanning.  (MAP_POPULATE
+ * would be the mmap(2) way to do this, but our memory comes from
+ * brk(2), not mmap(2).)
+ *
+ * RS_OPEN_MLOCK further mlock(2)'s the buffer, so its pages are never
+ * swapped out mid-stream.  mlock() faults in the pages as it locks
+ * them.  rs_open_flags() fails, returning NULL, if the mlock() fails,
+ * such as when over the RLIMIT_MEMLOCK resource limit.
+ */
+
+static int rawscan_prefault(RAWSCAN *rsp, unsigned flags)
+{
+    char *pg;
+
+    if (flags & RS_OPEN_MLOCK)
+        return mlock(rsp->buf, rsp->bufsz);
+
+    for (pg = (char *)rsp->buf; pg < rsp->buftop; pg += rsp->pgsz)
+        *(volatile char *)pg = '\0';
+    if (rsp->bufsz > 0)
+        *(volatile char *)(rsp->buftop - 1) = '\0';
+    return 0;
+}
+
 func_static RAWSCAN *rs_open (
   int fd,              // read input from this already open file descriptor
   size_t bufsz,        // handle lines at least this many bytes in one chunk
   char delimiterbyte)  // newline '\n' or other char marking end of "lines"
+{
+    return rs_open_flags(fd, bufsz, delimiterbyte, 0);
+}
+
+func_static RAWSCAN *rs_open_flags (
+  int fd,              // read input from this already open file descriptor
+  size_t bufsz,        // handle lines at least this many bytes in one chunk
+  char delimiterbyte,  // newline '\n' or other char marking end of "lines"
+  unsigned flags)      // RS_OPEN_* flags, or'd together
 {
     size_t pgsz;                // runtime hardware memory page size
     void *old_sbrk;             // initial data break (top of data seg)
@@ -382,6 +612,19 @@ func_static RAWSCAN *rs_open (
 
     pgsz = sysconf(_SC_PAGESIZE);
 
+    if (flags & RS_OPEN_COMPACT) {
+        // Buffers start on a cache line; the sentinel and guard
+        // rail nul bytes are the two bytes just past the buffer.
+        if ((rsp = rawscan_slab_alloc()) == NULL)
+            return NULL;
+        if ((buf = rawscan_arena_alloc(bufsz + 2, 64)) == NULL)
+            return NULL;
+        buftop = buf + bufsz;
+        buftop[0] = delimiterbyte;
+        buftop[1] = '\0';
+        goto init_rsp;
+    }
+
 // Round up x to next pgsz boundary
 #   define PageSzRnd(x)  (((((unsigned long)(x))+(pgsz)-1)/(pgsz))*(pgsz))
 
@@ -414,6 +657,7 @@ func_static RAWSCAN *rs_open (
     if (mprotect (buftop, pgsz, PROT_READ) < 0)
         return NULL;
 
+  init_rsp:
     memset(rsp, 0, sizeof(*rsp));
 
     rsp->buf = buf;
@@ -424,13 +668,22 @@ func_static RAWSCAN *rs_open (
     rsp->p = rsp->q = rsp->buftop;
 
     rsp->fd = fd;
+    rsp->flags = flags;
     rsp->pgsz = pgsz;
     rsp->bufsz = bufsz;
     rsp->min1stchunklen = bufsz;
+    rsp->max_readlen = bufsz;
     rsp->delimiterbyte = delimiterbyte;
     rsp->next_delim_ptr_peek = rsp->buftop;
 
     // Above memset() handles following:
+    // rsp->reader = NULL;
+    // rsp->reader_arg = NULL;
+    // rsp->closer = NULL;
+    // rsp->files = NULL;
+    // rsp->release_mark = NULL;
+    // rsp->shift_total = 0;
+    // rsp->peeked = false;
     // rsp->end_this_chunk = NULL;
     // rsp->next_val_p = NULL;
     // rsp->result = ...;
@@ -440,12 +693,23 @@ func_static RAWSCAN *rs_open (
     // rsp->eof_seen = false;
     // rsp->err_seen = false;
     // rsp->pause_on_inval = false;
+    // rsp->json = NULL;
+    // rsp->xform = NULL;
+    // rsp->pool_next = NULL;
+    // rsp->nfills = 0;
+    // rsp->filt = ...;
+
+    if (flags & (RS_OPEN_PREFAULT | RS_OPEN_MLOCK))
+        if (rawscan_prefault(rsp, flags) < 0)
+            return NULL;
 
-    assert (((uintptr_t)(rsp->buftop) % pgsz) == 0);
     assert (rsp->buf >= (const char *)buf);
     assert (rsp->buf + rsp->bufsz == rsp->buftop);
-    assert ((char *)rsp + pgsz <= rsp->buf);
     assert (sizeof(rsp) <= pgsz);
+    if (!(flags & RS_OPEN_COMPACT)) {
+        assert (((uintptr_t)(rsp->buftop) % pgsz) == 0);
+        assert ((char *)rsp + pgsz <= rsp->buf);
+    }
 
     return rsp;
 }
@@ -453,9 +717,50 @@ func_static RAWSCAN *rs_open (
 // Suppress warnings if the pause functions, or some parameters, aren't used.
 #define __unused__ __attribute__((unused))
 
-func_static void rs_close(RAWSCAN *rsp __unused__)
+/*
+ * rs_open_reader() is rs_open() for input that doesn't come
+ * directly from read(2) on a file descriptor.  Each time the
+ * buffer needs more data, rawscan calls reader(arg, buf, count),
+ * which must behave like read(2): put up to count bytes at buf
+ * and return how many, or return 0 at end of input, or -1 with
+ * errno set on error.  Otherwise the stream behaves exactly as
+ * if opened by rs_open().
+ */
+
+__unused__ func_static RAWSCAN *rs_open_reader (
+  rs_reader_fn reader, // call reader(arg, buf, count) to obtain more input
+  void *arg,           // passed unchanged to each reader() call
+  size_t bufsz,        // handle lines at least this many bytes in one chunk
+  char delimiterbyte)  // newline '\n' or other char marking end of "lines"
+{
+    RAWSCAN *rsp;
+
+    if ((rsp = rs_open(-1, bufsz, delimiterbyte)) == NULL)
+        return NULL;
+
+    rsp->reader = reader;
+    rsp->reader_arg = arg;
+
+    return rsp;
+}
+
+static void rawscan_json_free(RAWSCAN *rsp);
+static void rawscan_xform_apply(const struct rawscan_xform *xf, char *p,
+                                size_t n);
+
+func_static void rs_close(RAWSCAN *rsp)
 {
     // We don' t close rsp->fd ... we got it open and so we leave it open.
+    // But input engines that rawscan itself set up, such as the one
+    // behind rs_open_zframes(), are torn down here.
+
+    if (rsp->closer != NULL) {
+        rsp->closer(rsp->reader_arg);
+        rsp->closer = NULL;
+    }
+    rawscan_json_free(rsp);
+    free(rsp->xform);
+    rsp->xform = NULL;
     //
     // We could get fancy and see if the current data break, sbrk(0),
     // has not moved any further up since we moved it upward in the
@@ -464,7 +769,105 @@ func_static void rs_close(RAWSCAN *rsp __unused__)
     //
     // But I'm not presently sufficiently motivated to do that.
     //
-    // So this routine is currently a no-op.
+    // So this routine is otherwise a no-op.
+}
+
+/*
+ * rs_reopen(rsp, fd): rebind an open stream to a new input file
+ * descriptor, keeping its buffer and read-only sentinel page.
+ *
+ * Each rs_open() costs a sysconf(), a brk() and an mprotect() system
+ * call, and (as rs_close() frees nothing) more memory.  A program
+ * scanning many small files, one after another, can instead rs_open()
+ * once, and rs_reopen() that stream for each subsequent file, with
+ * no further memory allocation or system calls.
+ *
+ * All the per-input state (buffered data, the peek ahead, long line,
+ * end of file and error states, and any pending pause) is discarded,
+ * as if just opened by rs_open().  Settings made by the caller, such
+ * as rs_enable_pause(), rs_set_min1stchunklen() and rs_set_transform(),
+ * are kept.  Any data returned by earlier rs_getline() calls is
+ * invalidated.
+ *
+ * As with rs_close(), the previous fd is not closed.  If the stream
+ * was opened with rs_open_zframes() or rs_open_files(), the input
+ * machinery those set up is released, and the stream becomes a plain
+ * rs_open() stream reading fd.
+ */
+
+__unused__ func_static void rs_reopen(RAWSCAN *rsp, int fd)
+{
+    if (rsp->closer != NULL) {
+        rsp->closer(rsp->reader_arg);
+        rsp->closer = NULL;
+    }
+    rsp->reader = NULL;
+    rsp->reader_arg = NULL;
+    rsp->files = NULL;
+
+    rsp->fd = fd;
+    rsp->errnum = 0;
+
+    // As in rs_open(), p and q at buftop force a read on first call.
+    rsp->p = rsp->q = rsp->buftop;
+    rsp->next_delim_ptr_peek = rsp->buftop;
+    rsp->end_this_chunk = NULL;
+    rsp->next_val_p = NULL;
+    memset(&rsp->result, 0, sizeof(rsp->result));
+    rsp->release_mark = NULL;
+    rsp->shift_total = 0;
+    rsp->peeked = false;
+    rsp->nfills++;
+    memset(&rsp->filt, 0, sizeof(rsp->filt));
+
+    rsp->in_longline = false;
+    rsp->longline_ended = false;
+    rsp->terminate_current_pause = false;
+    rsp->eof_seen = false;
+    rsp->err_seen = false;
+}
+
+/*
+ * The stream pool: streams that the routines below that need streams
+ * of their own for each call (rs_dirscan(), rs_bulk_open(), rs_sort(),
+ * rs_dedup(), rs_partition() and rs_split()) are done with, kept for
+ * their next calls.
+ *
+ * As rs_close() frees nothing, those calls would otherwise each take
+ * more memory, for good.  Instead they rawscan_pool_get() streams,
+ * reused (by rs_reopen()) from the pool where one of the same buffer
+ * size and delimiterbyte is there, and rawscan_pool_put() them when
+ * done, so that a program calling them repeatedly only ever holds as
+ * many streams as the most it needed at once.  Pooled streams come
+ * back with the settings of a fresh rs_open().  Like rs_open(), not
+ * thread safe.
+ */
+
+static RAWSCAN *rawscan_pool;
+
+static RAWSCAN *rawscan_pool_get(int fd, size_t bufsz, char delimiterbyte)
+{
+    RAWSCAN **pp, *rsp;
+
+    for (pp = &rawscan_pool; (rsp = *pp) != NULL; pp = &rsp->pool_next) {
+        if (rsp->bufsz == bufsz && rsp->delimiterbyte == delimiterbyte) {
+            *pp = rsp->pool_next;
+            rsp->pool_next = NULL;
+            rs_reopen(rsp, fd);
+            rsp->pause_on_inval = false;
+            rsp->min1stchunklen = bufsz;
+            rsp->max_readlen = bufsz;
+            return rsp;
+        }
+    }
+    return rs_open(fd, bufsz, delimiterbyte);
+}
+
+static void rawscan_pool_put(RAWSCAN *rsp)
+{
+    rs_close(rsp);
+    rsp->pool_next = rawscan_pool;
+    rawscan_pool = rsp;
 }
 
 __unused__ func_static void rs_enable_pause(RAWSCAN *rsp)
@@ -483,6 +886,47 @@ __unused__ func_static void rs_resume_from_pause(RAWSCAN *rsp)
     rsp->terminate_current_pause = true;
 }
 
+/*
+ * rs_release_upto(rsp, ptr): a finer grained alternative to
+ * rs_resume_from_pause(), for streams with pause enabled.
+ *
+ * Tells rawscan that the caller no longer needs any bytes below ptr,
+ * but still needs the already returned bytes from ptr on up, such as
+ * the last few lines kept for context by a "grep -B" style consumer.
+ * ptr must point into data already returned by rs_getline() (or be
+ * just past the last byte returned); other values are clamped to
+ * that range.
+ *
+ * Then, when rs_getline() next runs out of room at the top of the
+ * buffer, rather than returning rt_paused, it moves the retained
+ * bytes, along with any partial line above them, down to the bottom
+ * of the buffer, in a single memmove, and carries on.  If the
+ * caller hasn't released anything since the last such move, then
+ * rs_getline() pauses as before.
+ *
+ * That move invalidates the caller's pointers into the retained
+ * data.  rs_get_shift_total() returns the total distance retained
+ * data has been moved down, since the stream was (re)opened.
+ * A pointer saved when that total was t0 now points t1 - t0 bytes
+ * too high, if the total is now t1.
+ */
+
+__unused__ func_static void rs_release_upto(RAWSCAN *rsp, const char *ptr)
+{
+    const char *top = rsp->peeked ? rsp->peeked_p : rsp->p;
+
+    if (ptr < rsp->buf)
+        ptr = rsp->buf;
+    if (ptr > top)
+        ptr = top;
+    rsp->release_mark = ptr;
+}
+
+__unused__ func_static size_t rs_get_shift_total(RAWSCAN *rsp)
+{
+    return rsp->shift_total;
+}
+
 /*
  * Return next "line" from rsp input.
  *
@@ -601,12 +1045,30 @@ static RAWSCAN_RESULT rawscan_err(RAWSCAN *rsp)
 
 static const char *rawscan_read (RAWSCAN *rsp)
 {
-    int cnt;
+    ssize_t cnt;
+    size_t len = rsp->buftop - rsp->q;          // room above q
+
+    rsp->nfills++;
+    if (len > rsp->max_readlen)
+        len = rsp->max_readlen;
+
+    // Input preloaded by rs_bulk_next() may already be known complete.
+    if (rsp->eof_seen)
+        return NULL;
 
-    cnt = read (rsp->fd, (void *)(rsp->q), rsp->buftop - rsp->q);
+    // Compact mode sentinel isn't write protected; refresh it.
+    if (rsp->flags & RS_OPEN_COMPACT)
+        *(char *)(rsp->buftop) = rsp->delimiterbyte;
+
+    if (rsp->reader != NULL)
+        cnt = rsp->reader(rsp->reader_arg, (void *)(rsp->q), len);
+    else
+        cnt = read (rsp->fd, (void *)(rsp->q), len);
 
     if (cnt > 0) {
         const char *pre_read_q = rsp->q;
+        if (rsp->xform != NULL)
+            rawscan_xform_apply(rsp->xform, (char *)rsp->q, cnt);
         rsp->q += cnt;
         if (rsp->q < rsp->buftop)   // reduce useless rawmemchr scanning
             *(char *)(rsp->q) = rsp->delimiterbyte;
@@ -734,6 +1196,32 @@ static void rawscan_shift_buffer_contents_down(RAWSCAN *rsp)
     rsp->q = new_q;
 }
 
+static bool rawscan_compact_released(RAWSCAN *rsp)
+{
+    // Instead of pausing, if rs_release_upto() released some of the
+    // buffer, then move everything above the release point (the data
+    // the caller retained, plus any partial line) down to the bottom
+    // of the buffer, in one memmove, and carry on.  The caller learns
+    // how far its retained data moved from rs_get_shift_total().
+
+    size_t howfartoshift;
+
+    if (rsp->release_mark == NULL || rsp->release_mark <= rsp->buf)
+        return false;
+
+    assert(rsp->release_mark <= rsp->p);
+    howfartoshift = rsp->release_mark - rsp->buf;
+
+    memmove((void *)rsp->buf, rsp->release_mark, rsp->q - rsp->release_mark);
+
+    rsp->p -= howfartoshift;
+    rsp->q -= howfartoshift;
+    rsp->release_mark = rsp->buf;       // retained data now starts here
+    rsp->shift_total += howfartoshift;
+
+    return true;
+}
+
 static RAWSCAN_RESULT rawscan_handle_end_of_longline(RAWSCAN *rsp)
 {
     // If we come upon the end of a longline, either by finding a
@@ -759,6 +1247,10 @@ static RAWSCAN_RESULT rawscan_handle_end_of_longline(RAWSCAN *rsp)
 
 func_static RAWSCAN_RESULT rs_getline (RAWSCAN *rsp) __attribute__ ((hot));
 static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp);
+static RAWSCAN_RESULT rawscan_getline_slow (RAWSCAN *rsp);
+static bool rawscan_next_file(RAWSCAN *rsp);
+static void rawscan_files_returned(RAWSCAN *rsp);
+static void rawscan_files_unreturned(RAWSCAN *rsp, size_t file_index);
 
 func_static RAWSCAN_RESULT rs_getline (RAWSCAN *rsp)
 {
@@ -782,12 +1274,31 @@ func_static RAWSCAN_RESULT rs_getline (RAWSCAN *rsp)
     return rs_getline_morecode(rsp);
 }
 
+// Only here, never in the fast path above, can the stream go on to
+// the next of a list of files, so only here need rs_get_file_index()
+// be told which file the result came from.  (A peek puts that back.)
+
 static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp)
+{
+    RAWSCAN_RESULT rt = rawscan_getline_slow(rsp);
+
+    if (rsp->files != NULL)
+        rawscan_files_returned(rsp);
+    return rt;
+}
+
+static RAWSCAN_RESULT rawscan_getline_slow (RAWSCAN *rsp)
 {
     const char *next_delim_ptr;
     const char *start_next_rawmemchr_here;
     size_t len;                                 // how many chars in [p, q)
 
+    if (rsp->peeked) {                          // return what was peeked
+        rsp->peeked = false;
+        rsp->next_delim_ptr_peek = rsp->peeked_delim_ptr_peek;
+        return rsp->result;
+    }
+
     if (rsp->in_longline) {
         // finish off two-step longline termination
         if (rsp->longline_ended) {
@@ -882,6 +1393,16 @@ static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp)
             rsp->next_val_p = NULL;
             return rawscan_handle_end_of_longline(rsp);
         } else if (rsp->eof_seen) {
+            // If reading a list of files, go on to the next one.
+            // Its first line starts at rsp->q, so the last line of
+            // the previous file, already returned above, and perhaps
+            // lacking a final delimiterbyte, isn't joined to it.
+            if (rsp->files != NULL && rawscan_next_file(rsp)) {
+                start_next_rawmemchr_here = rsp->buftop;
+                goto slow_loop;
+            }
+            if (rsp->err_seen)                  // next file open failed
+                return rawscan_err(rsp);
             return rawscan_eof(rsp);
         } else {
             return rawscan_err(rsp);
@@ -900,11 +1421,16 @@ static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp)
         assert(len < rsp->min1stchunklen || rsp->in_longline);
         if (rsp->p > rsp->buf) {                    // have space below p
             if (rsp->pause_on_inval && !rsp->terminate_current_pause) {
+                if (rawscan_compact_released(rsp)) {
+                    start_next_rawmemchr_here = rsp->buftop;
+                    goto slow_loop;
+                }
                 return rawscan_paused(rsp);
             } else {
                 rawscan_shift_buffer_contents_down(rsp);
                 start_next_rawmemchr_here = rsp->buftop;
                 rsp->terminate_current_pause = false;    // reset pause logic
+                rsp->release_mark = NULL;
                 goto slow_loop;
             }
         } else {
@@ -924,10 +1450,15 @@ static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp)
         // reset buffers and read some more, or pause awaiting a resume.
 
         if (rsp->pause_on_inval && !rsp->terminate_current_pause) {
+            if (rawscan_compact_released(rsp)) {
+                start_next_rawmemchr_here = rsp->buftop;
+                goto slow_loop;
+            }
             return rawscan_paused(rsp);
         } else {
             rsp->p = rsp->q = rsp->buf;                 // reset buffers
             rsp->terminate_current_pause = false;       // reset pause logic
+            rsp->release_mark = NULL;
             start_next_rawmemchr_here = rawscan_read(rsp);
             if (start_next_rawmemchr_here == NULL) {
                 start_next_rawmemchr_here = rsp->buftop;
@@ -940,6 +1471,266 @@ static RAWSCAN_RESULT rs_getline_morecode (RAWSCAN *rsp)
     assert("internal rawscan library logic error" ? 0 : 0);
 }
 
+/*
+ * rs_peekline(rsp): return what the next rs_getline() will return,
+ * without consuming it.
+ *
+ * For merge style consumers, and parsers that need one line of
+ * lookahead (such as to decide whether the next line continues the
+ * current record), without copying the line out of the buffer.
+ *
+ * The peeked line or chunk is returned again, with the same begin
+ * and end pointers, by the next rs_getline().  Peeking more than once
+ * in a row returns the same result each time.  The peeked pointers
+ * remain valid exactly as long as those of that next rs_getline()
+ * would, that is, until the rs_getline() call after that one.
+ *
+ * Peeking never invalidates the prior rs_getline() result: it may
+ * read more input above what's buffered, but won't move or overwrite
+ * buffered data.  If the next line can't be had without doing so, the
+ * peek returns rt_paused, as if pause were enabled, whether or not it
+ * is; once done with the prior line, call rs_getline() to get it.
+ *
+ * Peeking a pause, end of file or error doesn't change the stream's
+ * state, and so the following rs_getline() just recomputes it, which
+ * allows, for example, rs_resume_from_pause() after peeking rt_paused.
+ */
+
+// may_move: the caller is done with the prior result, so the peek may
+// move the buffer, as rs_getline() would.
+
+static RAWSCAN_RESULT rawscan_peekline(RAWSCAN *rsp, bool may_move)
+{
+    RAWSCAN_RESULT rt;
+    const char *p = rsp->p;
+    size_t file_index = rs_get_file_index(rsp);
+
+    if (rsp->peeked)
+        return rsp->result;
+
+    if (may_move) {
+        rt = rs_getline(rsp);
+    } else {
+        // Pause wherever rs_getline() would move buffered data.
+        bool pause_on_inval = rsp->pause_on_inval;
+        bool terminate_current_pause = rsp->terminate_current_pause;
+        const char *release_mark = rsp->release_mark;
+
+        rsp->pause_on_inval = true;
+        rsp->terminate_current_pause = false;
+        rsp->release_mark = NULL;
+        rt = rs_getline(rsp);
+        rsp->pause_on_inval = pause_on_inval;
+        rsp->terminate_current_pause = terminate_current_pause;
+        rsp->release_mark = release_mark;
+    }
+
+    // The line just returned is still the caller's, even if the peek
+    // went on to the next file.
+    if (rsp->files != NULL)
+        rawscan_files_unreturned(rsp, file_index);
+
+    if (rt.type == rt_paused || rt.type == rt_eof || rt.type == rt_err)
+        return rt;
+
+    // Park next_delim_ptr_peek at buftop, so the rs_getline() fast
+    // path fails (nothing is below buftop and at or above q), and
+    // rs_getline_morecode() returns the peeked result again.
+
+    rsp->peeked = true;
+    rsp->peeked_delim_ptr_peek = rsp->next_delim_ptr_peek;
+    rsp->peeked_p = p;
+    rsp->next_delim_ptr_peek = rsp->buftop;
+
+    return rt;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_peekline(RAWSCAN *rsp)
+{
+    return rawscan_peekline(rsp, false);
+}
+
+/*
+ * rawscan_hash64(p, len, seed): the 64 bit line hash shared by
+ * rs_getline_hashed() and rs_hash64(), by rs_dedup() (seeded with its
+ * spill level, to split a spill file's lines differently from those
+ * of the level before) and, through rs_hash64(), by rs_partition().
+ * It's a wyhash style hash, taking 16 bytes per step, each step a
+ * single 64 x 64 -> 128 bit multiply.  rawscan_hash_add() takes the
+ * same steps over bytes added a piece at a time, so that
+ * rawscan_hash_value() of a line added in pieces is rawscan_hash64()
+ * of the whole line, wherever the pieces split it.
+ */
+
+static inline uint64_t rawscan_mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t)a * b;
+
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t rawscan_load64(const char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t rawscan_load32(const char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#define RAWSCAN_HASH_K0 UINT64_C(0xa0761d6478bd642f)
+#define RAWSCAN_HASH_K1 UINT64_C(0xe7037ed1a0b428db)
+#define RAWSCAN_HASH_K2 UINT64_C(0x8ebc6af09c88c6e3)
+
+// One 16 byte step.
+
+static inline uint64_t rawscan_hash_step(uint64_t h, const char *p)
+{
+    return rawscan_mum(rawscan_load64(p) ^ RAWSCAN_HASH_K1,
+                       rawscan_load64(p + 8) ^ h);
+}
+
+// The last n (0 .. 16) bytes, at p, of a len byte line, whose steps
+// before them left h.
+
+static inline uint64_t rawscan_hash_finish(uint64_t h, const char *p,
+                                           size_t n, size_t len)
+{
+    const uint64_t k1 = RAWSCAN_HASH_K1;
+    const uint64_t k2 = RAWSCAN_HASH_K2;
+    uint64_t a, b;
+
+    if (n >= 8) {                       // 8 .. 16 bytes, maybe overlapping
+        a = rawscan_load64(p);
+        b = rawscan_load64(p + n - 8);
+    } else if (n >= 4) {
+        a = rawscan_load32(p) << 32 | rawscan_load32(p + n - 4);
+        b = 0;
+    } else if (n > 0) {
+        a = (uint64_t)(unsigned char)p[0] << 16
+          | (uint64_t)(unsigned char)p[n >> 1] << 8
+          | (unsigned char)p[n - 1];
+        b = 0;
+    } else {
+        a = b = 0;
+    }
+    return rawscan_mum(rawscan_mum(a ^ k1, b ^ h) ^ k2, len ^ k1);
+}
+
+// wyhash style 64 bit hash of the len bytes at p.
+
+static inline uint64_t rawscan_hash64(const char *p, size_t len, uint64_t seed)
+{
+    uint64_t h = seed ^ RAWSCAN_HASH_K0;
+    size_t n = len;
+
+    for (; n > 16; n -= 16, p += 16)
+        h = rawscan_hash_step(h, p);
+    return rawscan_hash_finish(h, p, n, len);
+}
+
+static void rawscan_hash_init(struct rawscan_hash_state *st, uint64_t seed)
+{
+    st->h = seed ^ RAWSCAN_HASH_K0;
+    st->len = st->ntail = 0;
+}
+
+// Add the n bytes at p.  As in rawscan_hash64(), the last 1 to 16
+// bytes aren't stepped over, but kept in tail, until more follow.
+
+static void rawscan_hash_add(struct rawscan_hash_state *st, const char *p,
+                             size_t n)
+{
+    st->len += n;
+    if (st->ntail + n <= 16) {
+        memcpy(st->tail + st->ntail, p, n);
+        st->ntail += n;
+        return;
+    }
+    if (st->ntail > 0) {                        // more follow the tail
+        size_t k = 16 - st->ntail;
+
+        memcpy(st->tail + st->ntail, p, k);
+        p += k;
+        n -= k;
+        st->h = rawscan_hash_step(st->h, st->tail);
+    }
+    for (; n > 16; n -= 16, p += 16)
+        st->h = rawscan_hash_step(st->h, p);
+    memcpy(st->tail, p, n);
+    st->ntail = n;
+}
+
+static uint64_t rawscan_hash_value(const struct rawscan_hash_state *st)
+{
+    return rawscan_hash_finish(st->h, st->tail, st->ntail, st->len);
+}
+
+__unused__ func_static uint64_t rs_hash64(const char *p, size_t len)
+{
+    return rawscan_hash64(p, len, 0);
+}
+
+/*
+ * rs_getline_hashed(rsp, &hash): rs_getline(), also setting hash to a
+ * 64 bit hash of the line returned.
+ *
+ * For consumers that hash every line (to shard, deduplicate or join)
+ * and would otherwise take a second pass over each line's bytes
+ * later.  The hash isn't fused into the delimiter search: it is a
+ * separate pass, but made right after rs_getline() has found the
+ * line's end, with rawmemchr(), so while the line is still in L1
+ * cache.
+ *
+ * *hash is rs_hash64() of the line, not including any ending
+ * delimiterbyte, so that the same line hashes the same whether or not
+ * it has one, and the same as rs_hash64() of that line's bytes from
+ * anywhere else, as in another process.  That holds for long lines
+ * too, whatever the buffer size: for each long line chunk *hash is
+ * the hash of the line so far, and the hash of the whole line is
+ * returned with rt_longline_ended.  For other results *hash is 0.
+ */
+
+__unused__ func_static RAWSCAN_RESULT rs_getline_hashed(RAWSCAN *rsp,
+                                                       uint64_t *hash)
+{
+    RAWSCAN_RESULT rt = rs_getline(rsp);
+
+    switch (rt.type) {
+    case rt_full_line:
+        *hash = rawscan_hash64(rt.line.begin, rt.line.end - rt.line.begin, 0);
+        break;
+    case rt_full_line_without_eol:
+        *hash = rawscan_hash64(rt.line.begin,
+                               rt.line.end - rt.line.begin + 1, 0);
+        break;
+    case rt_start_longline:
+        rawscan_hash_init(&rsp->longline_hash, 0);
+        /* fall through */
+    case rt_within_longline:
+        // Only the last chunk can end with the delimiterbyte.
+        rawscan_hash_add(&rsp->longline_hash, rt.line.begin,
+                         rt.line.end - rt.line.begin +
+                                (*rt.line.end != rsp->delimiterbyte));
+        *hash = rawscan_hash_value(&rsp->longline_hash);
+        break;
+    case rt_longline_ended:
+        *hash = rawscan_hash_value(&rsp->longline_hash);
+        break;
+    default:
+        *hash = 0;
+        break;
+    }
+    return rt;
+}
+
 /*
  * "min1stchunklen" is the guaranteed minimum length of the first
  * chunk of a long line, or minimum length of a full line, that
@@ -1045,3 +1836,5325 @@ func_static size_t rs_get_min1stchunklen(RAWSCAN *rsp)
 {
     return rsp->min1stchunklen;
 }
+
+/*
+ * "max_readlen" is the most bytes that rawscan_read() will ask
+ * for in any one read.  By default it is the buffer size, so each
+ * read asks to fill all of the buffer above rsp->q.
+ *
+ * With a large buffer, say 256 MBytes, chosen so that long lines
+ * can still be returned in one piece, such a read writes far more
+ * data than fits in the L2 or L3 cache before rs_getline() looks
+ * at the start of it again, so that rawmemchr() scans the data back
+ * in from main memory.  rs_set_max_readlen(rsp, 256*1024) caps each
+ * read to a cache sized window, so freshly read data is scanned while
+ * still in cache.  Lines up to the full buffer size are still handled
+ * as before, as rs_getline() just keeps reading, a window at a time,
+ * until it finds the end of the line or fills the buffer.
+ *
+ * rs_set_max_readlen() fails, returning -1 and doing nothing else,
+ * if max_readlen is zero or greater than that stream's buffer size.
+ * Otherwise it sets max_readlen and returns 0.
+ */
+
+__unused__ func_static int rs_set_max_readlen(RAWSCAN *rsp, size_t max_readlen)
+{
+    if (max_readlen == 0 || max_readlen > rsp->bufsz)
+        return -1;
+
+    rsp->max_readlen = max_readlen;
+    return 0;
+}
+
+__unused__ func_static size_t rs_get_max_readlen(RAWSCAN *rsp)
+{
+    return rsp->max_readlen;
+}
+
+/*
+ * rs_open_zframes(): parallel decompression of multi-frame input.
+ *
+ * BGZF files (the blocked gzip used by bgzip, samtools and tabix)
+ * and zstd files written as multiple frames (zstd --rsyncable,
+ * pzstd, or the seekable zstd format) are sequences of independently
+ * compressed frames.  A single thread inflating such a file runs
+ * at perhaps 1 GByte/sec, well below the rate at which rs_getline()
+ * can scan the result, so here we hand successive frames out to a
+ * pool of worker threads, and then feed the decompressed frames,
+ * strictly in input order, into the stream's buffer through the
+ * rs_open_reader() hook.
+ *
+ * The calling thread does all the read(2)'s of compressed input,
+ * splitting that input into frames using the frame headers, and
+ * queuing each frame into the next free slot of a ring of slots.
+ * Worker threads take the oldest queued slot, decompress its frame
+ * into that slot's private output buffer, and mark it done.  The
+ * rawscan_zframes_read() reader routine copies the output of the
+ * oldest slot into the rawscan buffer, once that slot is done.
+ *
+ * Lines spanning frame boundaries need no special handling here.
+ * To rs_getline(), the decompressed frames are just successive
+ * read() returns, and it already stitches lines that span reads.
+ *
+ * Decompressing directly into the rawscan buffer would save one
+ * memcpy per byte, but the rawscan buffer only has room for the
+ * next frame in order, which would serialize the workers.
+ *
+ * Ordinary gzip input (not BGZF) is one deflate stream per member,
+ * with no block boundaries to split it at, so it is inflated
+ * serially, on the calling thread, straight into the rawscan buffer.
+ * Other input, in none of these formats, is passed through as is.
+ */
+
+enum rawscan_zformat {
+    zf_raw,                 // not compressed: pass input through
+    zf_bgzf,                // blocked gzip, each block at most 64 KBytes
+    zf_gzip,                // other gzip: one or more members, inflated serially
+    zf_zstd,                // one or more zstd frames
+};
+
+enum rawscan_zslot_state {
+    zs_empty,               // free for the next frame
+    zs_queued,              // holds a compressed frame, awaiting a worker
+    zs_busy,                // a worker is decompressing this frame
+    zs_done,                // decompressed output ready (or errnum set)
+};
+
+struct rawscan_zslot {
+    char *in;               // compressed frame
+    size_t inlen, incap;
+    char *out;              // decompressed frame
+    size_t outlen, outcap;
+    size_t outpos;          // how much of out already copied to rawscan
+    enum rawscan_zslot_state state;
+    int errnum;             // errno if decompression failed
+};
+
+typedef struct rawscan_zframes {
+    int fd;                 // compressed input read from here
+    enum rawscan_zformat format;
+
+    // Slot ring: slots with sequence numbers in [head, tail) are
+    // queued, busy or done, in input order; slot for sequence
+    // number n is slots[n % nslots].  Protected by lock.
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;     // workers wait here for queued slots
+    pthread_cond_t done_cv;     // reader waits here for head slot done
+    struct rawscan_zslot *slots;
+    unsigned long nslots, head, tail;
+    bool shutdown;              // tells workers to exit
+
+    pthread_t *threads;
+    int nthreads;
+
+    // Compressed read-ahead: bytes [stagebeg, stageend) of stage
+    // are read from fd but not yet queued.  Only touched by the
+    // calling (rs_getline) thread.
+
+    char *stage;
+    size_t stagebeg, stageend, stagecap;
+    bool read_eof;              // read(2) returned 0 or failed
+    bool input_eof;             // no more frames to queue
+    int input_errnum;           // errno of failed read or bad frame
+
+#if RAWSCAN_WITH_ZLIB
+    z_stream gz;                // zf_gzip inflate state
+    bool gz_ready;              // gz is set up (for rawscan_zframes_close)
+    bool in_member;             // gz has begun a member, not yet ended
+#endif
+} rawscan_zframes;
+
+// Ensure at least "need" bytes are staged.  Return 0 if so, else
+// -1, with input_errnum set if that's due to a failed read.
+
+static int rawscan_zframes_fill(rawscan_zframes *z, size_t need)
+{
+    while (z->stageend - z->stagebeg < need) {
+        ssize_t cnt;
+
+        if (z->read_eof)
+            return -1;
+
+        if (z->stagebeg > 0) {                  // shift staged bytes down
+            memmove(z->stage, z->stage + z->stagebeg,
+                                        z->stageend - z->stagebeg);
+            z->stageend -= z->stagebeg;
+            z->stagebeg = 0;
+        }
+        if (z->stagecap < need) {
+            size_t newcap = z->stagecap * 2;
+            char *newstage;
+
+            while (newcap < need)
+                newcap *= 2;
+            if ((newstage = realloc(z->stage, newcap)) == NULL) {
+                z->input_errnum = ENOMEM;
+                return -1;
+            }
+            z->stage = newstage;
+            z->stagecap = newcap;
+        }
+
+        cnt = read(z->fd, z->stage + z->stageend, z->stagecap - z->stageend);
+        if (cnt > 0) {
+            z->stageend += cnt;
+        } else {
+            if (cnt < 0)
+                z->input_errnum = errno;
+            z->read_eof = true;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#define rawscan_get_le16(p) ((size_t)(unsigned char)(p)[0] | \
+                            ((size_t)(unsigned char)(p)[1] << 8))
+#define rawscan_get_le32(p) (rawscan_get_le16(p) | \
+                            (rawscan_get_le16((p) + 2) << 16))
+
+// Given a gzip header with FEXTRA, of 12 + xlen bytes, return the
+// BGZF block size (BSIZE + 1) from its "BC" subfield, or 0 if it has
+// none (or its subfields overrun xlen): then it isn't BGZF.
+
+static size_t rawscan_bgzf_bsize(const char *hdr, size_t xlen)
+{
+    size_t off, slen;
+
+    for (off = 12; off + 4 <= 12 + xlen; off += 4 + slen) {
+        slen = rawscan_get_le16(hdr + off + 2);
+        if (off + 4 + slen > 12 + xlen)
+            return 0;
+        if (hdr[off] == 'B' && hdr[off+1] == 'C' && slen == 2)
+            return rawscan_get_le16(hdr + off + 4) + 1;
+    }
+    return 0;
+}
+
+// Return length of the next complete frame, now staged at
+// stage + stagebeg, or 0 if no more frames (input_eof set).
+
+static size_t rawscan_zframes_next_len(rawscan_zframes *z)
+{
+    if (rawscan_zframes_fill(z, 1) < 0) {
+        z->input_eof = true;                    // end of input, or error
+        return 0;
+    } else if (z->format == zf_bgzf) {
+        // gzip header, with FEXTRA holding a "BC" subfield that
+        // gives the total block size less one (BSIZE).
+        const char *hdr;
+        size_t xlen, bsize;
+
+        if (rawscan_zframes_fill(z, 12) < 0)
+            goto truncated;
+        xlen = rawscan_get_le16(z->stage + z->stagebeg + 10);
+        if (rawscan_zframes_fill(z, 12 + xlen) < 0)
+            goto truncated;
+        hdr = z->stage + z->stagebeg;
+        if ((unsigned char)hdr[0] != 0x1f || (unsigned char)hdr[1] != 0x8b
+                                                || (hdr[3] & 4) == 0)
+            goto corrupt;
+        if ((bsize = rawscan_bgzf_bsize(hdr, xlen)) < 12 + xlen + 8)
+            goto corrupt;                       // (0 if not BGZF)
+        if (rawscan_zframes_fill(z, bsize) < 0)
+            goto truncated;
+        return bsize;
+    } else {
+#if RAWSCAN_WITH_ZSTD
+        // Frame length isn't in the frame header; have libzstd walk
+        // the block headers, staging more input until it succeeds.
+        size_t need = 18;       // ZSTD_FRAMEHEADERSIZE_MAX (static API)
+
+        for (;;) {
+            size_t have = z->stageend - z->stagebeg;
+            size_t len = ZSTD_findFrameCompressedSize(
+                                    z->stage + z->stagebeg, have);
+            if (!ZSTD_isError(len))
+                return len;
+            if (ZSTD_getErrorCode(len) != ZSTD_error_srcSize_wrong)
+                goto corrupt;
+            need = have < need ? need : 2 * have;
+            if (rawscan_zframes_fill(z, need) < 0 &&
+                                    z->stageend - z->stagebeg == have)
+                goto truncated;
+        }
+#else
+        goto corrupt;
+#endif
+    }
+
+  truncated:
+    if (z->input_errnum == 0)
+        z->input_errnum = EILSEQ;
+    z->input_eof = true;
+    return 0;
+
+  corrupt:
+    z->input_errnum = EILSEQ;
+    z->input_eof = true;
+    return 0;
+}
+
+// Queue frames into free slots, until out of slots or frames.
+
+static void rawscan_zframes_queue(rawscan_zframes *z)
+{
+    while (!z->input_eof && z->tail - z->head < z->nslots) {
+        struct rawscan_zslot *slot = &z->slots[z->tail % z->nslots];
+        size_t len;
+
+        if ((len = rawscan_zframes_next_len(z)) == 0)
+            break;
+
+        assert(slot->state == zs_empty);
+        if (slot->incap < len) {
+            char *newin;
+
+            if ((newin = realloc(slot->in, len)) == NULL) {
+                z->input_errnum = ENOMEM;
+                z->input_eof = true;
+                break;
+            }
+            slot->in = newin;
+            slot->incap = len;
+        }
+        memcpy(slot->in, z->stage + z->stagebeg, len);
+        z->stagebeg += len;
+        slot->inlen = len;
+        slot->outlen = slot->outpos = 0;
+        slot->errnum = 0;
+
+        pthread_mutex_lock(&z->lock);
+        slot->state = zs_queued;
+        z->tail++;
+        pthread_cond_signal(&z->work_cv);
+        pthread_mutex_unlock(&z->lock);
+    }
+}
+
+// Make room for at least outlen bytes of output in slot.
+
+__unused__ static int rawscan_zslot_reserve(struct rawscan_zslot *slot, size_t outlen)
+{
+    char *newout;
+
+    if (slot->outcap >= outlen)
+        return 0;
+    if ((newout = realloc(slot->out, outlen)) == NULL)
+        return ENOMEM;
+    slot->out = newout;
+    slot->outcap = outlen;
+    return 0;
+}
+
+// Decompress one frame.  Return 0 or errno.  The per-thread
+// decompression context is passed in, so it can be reused.
+
+#if RAWSCAN_WITH_ZLIB
+static int rawscan_zslot_inflate(struct rawscan_zslot *slot, z_stream *zs)
+{
+    size_t xlen = rawscan_get_le16(slot->in + 10);
+    size_t isize = rawscan_get_le32(slot->in + slot->inlen - 4);
+    int err;
+
+    if ((err = rawscan_zslot_reserve(slot, isize + 1)) != 0)
+        return err;
+
+    // Raw deflate data lies between header and CRC32 + ISIZE trailer.
+    inflateReset(zs);
+    zs->next_in = (unsigned char *)slot->in + 12 + xlen;
+    zs->avail_in = slot->inlen - 12 - xlen - 8;
+    zs->next_out = (unsigned char *)slot->out;
+    zs->avail_out = slot->outcap;
+
+    if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != isize)
+        return EILSEQ;
+    slot->outlen = isize;
+    return 0;
+}
+#endif
+
+#if RAWSCAN_WITH_ZSTD
+static int rawscan_zslot_unzstd(struct rawscan_zslot *slot, ZSTD_DCtx *dctx)
+{
+    unsigned long long csize = ZSTD_getFrameContentSize(slot->in, slot->inlen);
+    ZSTD_inBuffer zin = { slot->in, slot->inlen, 0 };
+    int err;
+
+    if (csize == ZSTD_CONTENTSIZE_ERROR)
+        return EILSEQ;
+    if (csize == ZSTD_CONTENTSIZE_UNKNOWN)
+        csize = ZSTD_DStreamOutSize();
+    if ((err = rawscan_zslot_reserve(slot, csize)) != 0)
+        return err;
+
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    for (;;) {
+        ZSTD_outBuffer zout = { slot->out, slot->outcap, slot->outlen };
+        size_t ret = ZSTD_decompressStream(dctx, &zout, &zin);
+
+        slot->outlen = zout.pos;
+        if (ZSTD_isError(ret))
+            return EILSEQ;
+        if (ret == 0)
+            return 0;
+        if (zin.pos == zin.size && zout.pos < zout.size)
+            return EILSEQ;                      // frame truncated
+        if (slot->outlen == slot->outcap &&
+            (err = rawscan_zslot_reserve(slot, 2 * slot->outcap)) != 0)
+            return err;
+    }
+}
+#endif
+
+static void *rawscan_zframes_worker(void *arg)
+{
+    rawscan_zframes *z = arg;
+    int initerr = 0;            // if can't set up, fail each frame with it
+
+#if RAWSCAN_WITH_ZLIB
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    if (z->format == zf_bgzf && inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+        initerr = ENOMEM;
+#endif
+#if RAWSCAN_WITH_ZSTD
+    ZSTD_DCtx *dctx = NULL;
+
+    if (z->format == zf_zstd && (dctx = ZSTD_createDCtx()) == NULL)
+        initerr = ENOMEM;
+#endif
+
+    pthread_mutex_lock(&z->lock);
+    for (;;) {
+        struct rawscan_zslot *slot = NULL;
+        unsigned long seq;
+
+        for (seq = z->head; seq < z->tail; seq++) {
+            if (z->slots[seq % z->nslots].state == zs_queued) {
+                slot = &z->slots[seq % z->nslots];
+                break;
+            }
+        }
+        if (z->shutdown)
+            break;
+        if (slot == NULL) {
+            pthread_cond_wait(&z->work_cv, &z->lock);
+            continue;
+        }
+
+        slot->state = zs_busy;
+        pthread_mutex_unlock(&z->lock);
+
+        slot->errnum = initerr ? initerr : EILSEQ;
+#if RAWSCAN_WITH_ZLIB
+        if (z->format == zf_bgzf && !initerr)
+            slot->errnum = rawscan_zslot_inflate(slot, &zs);
+#endif
+#if RAWSCAN_WITH_ZSTD
+        if (z->format == zf_zstd && !initerr)
+            slot->errnum = rawscan_zslot_unzstd(slot, dctx);
+#endif
+
+        pthread_mutex_lock(&z->lock);
+        slot->state = zs_done;
+        pthread_cond_broadcast(&z->done_cv);
+    }
+    pthread_mutex_unlock(&z->lock);
+
+#if RAWSCAN_WITH_ZLIB
+    if (z->format == zf_bgzf && initerr == 0)
+        inflateEnd(&zs);
+#endif
+#if RAWSCAN_WITH_ZSTD
+    ZSTD_freeDCtx(dctx);
+#endif
+    return NULL;
+}
+
+#if RAWSCAN_WITH_ZLIB
+
+// Inflate zf_gzip input into buf, up to count bytes, a member at a
+// time.  Like read(2), return 0 only at the end of input, and then
+// only if that's also the end of a member.
+
+static ssize_t rawscan_zframes_gunzip(rawscan_zframes *z, void *buf,
+                                      size_t count)
+{
+    z_stream *zs = &z->gz;
+    int ret;
+
+    zs->next_out = (unsigned char *)buf;
+    zs->avail_out = count;
+    while (zs->avail_out == count) {
+        if (z->stagebeg == z->stageend && rawscan_zframes_fill(z, 1) < 0) {
+            if (z->input_errnum == 0 && !z->in_member)
+                return 0;
+            errno = z->input_errnum ? z->input_errnum : EILSEQ;
+            return -1;                          // (EILSEQ: truncated)
+        }
+        zs->next_in = (unsigned char *)z->stage + z->stagebeg;
+        zs->avail_in = z->stageend - z->stagebeg;
+        z->in_member = true;
+        ret = inflate(zs, Z_NO_FLUSH);
+        z->stagebeg = z->stageend - zs->avail_in;
+        if (ret == Z_STREAM_END) {              // next member, if any
+            inflateReset(zs);
+            z->in_member = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            errno = ret == Z_MEM_ERROR ? ENOMEM : EILSEQ;
+            return -1;
+        }
+    }
+    return count - zs->avail_out;
+}
+
+#endif
+
+// The rs_reader_fn for rs_open_zframes() streams.
+
+static ssize_t rawscan_zframes_read(void *arg, void *buf, size_t count)
+{
+    rawscan_zframes *z = arg;
+
+#if RAWSCAN_WITH_ZLIB
+    if (z->format == zf_gzip)
+        return rawscan_zframes_gunzip(z, buf, count);
+#endif
+    if (z->format == zf_raw) {
+        // Pass through: first the bytes staged while sniffing
+        // the format, then straight read(2)'s.
+        if (z->stagebeg < z->stageend) {
+            size_t n = z->stageend - z->stagebeg;
+
+            n = n < count ? n : count;
+            memcpy(buf, z->stage + z->stagebeg, n);
+            z->stagebeg += n;
+            return n;
+        }
+        return read(z->fd, buf, count);
+    }
+
+    for (;;) {
+        struct rawscan_zslot *slot;
+
+        rawscan_zframes_queue(z);
+
+        if (z->head == z->tail) {               // nothing left in flight
+            if (z->input_errnum != 0) {
+                errno = z->input_errnum;
+                return -1;
+            }
+            return 0;
+        }
+
+        slot = &z->slots[z->head % z->nslots];
+
+        pthread_mutex_lock(&z->lock);
+        while (slot->state != zs_done)
+            pthread_cond_wait(&z->done_cv, &z->lock);
+        pthread_mutex_unlock(&z->lock);
+
+        if (slot->errnum != 0) {
+            errno = slot->errnum;
+            return -1;
+        }
+
+        if (slot->outpos < slot->outlen) {
+            size_t n = slot->outlen - slot->outpos;
+
+            n = n < count ? n : count;
+            memcpy(buf, slot->out + slot->outpos, n);
+            slot->outpos += n;
+            return n;
+        }
+
+        pthread_mutex_lock(&z->lock);
+        slot->state = zs_empty;
+        z->head++;
+        pthread_mutex_unlock(&z->lock);
+    }
+}
+
+static void rawscan_zframes_close(void *arg)
+{
+    rawscan_zframes *z = arg;
+    unsigned long i;
+    int t;
+
+    if (z->threads != NULL) {
+        pthread_mutex_lock(&z->lock);
+        z->shutdown = true;
+        pthread_cond_broadcast(&z->work_cv);
+        pthread_mutex_unlock(&z->lock);
+
+        for (t = 0; t < z->nthreads; t++)
+            pthread_join(z->threads[t], NULL);
+
+        pthread_cond_destroy(&z->done_cv);
+        pthread_cond_destroy(&z->work_cv);
+        pthread_mutex_destroy(&z->lock);
+        free(z->threads);
+    }
+
+    for (i = 0; i < z->nslots; i++) {
+        free(z->slots[i].in);
+        free(z->slots[i].out);
+    }
+#if RAWSCAN_WITH_ZLIB
+    if (z->gz_ready)
+        inflateEnd(&z->gz);
+#endif
+    free(z->slots);
+    free(z->stage);
+    free(z);
+}
+
+__unused__ func_static RAWSCAN *rs_open_zframes (
+  int fd,              // read compressed input from this file descriptor
+  size_t bufsz,        // handle lines at least this many bytes in one chunk
+  char delimiterbyte,  // newline '\n' or other char marking end of "lines"
+  int nthreads)        // number of decompression threads (<= 0: ncpus)
+{
+    static const unsigned char zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+    rawscan_zframes *z;
+    RAWSCAN *rsp;
+    pthread_t *threads;
+    const unsigned char *magic;
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+
+    if ((z = calloc(1, sizeof(*z))) == NULL)
+        return NULL;
+    z->fd = fd;
+    z->stagecap = 128*1024;
+    if ((z->stage = malloc(z->stagecap)) == NULL)
+        goto fail;
+
+    // Sniff the format from the first bytes of input.  If that read
+    // fails, leave it to the first rs_getline() to fail it again.
+    // gzip input is BGZF only if its first member's FEXTRA field
+    // has a "BC" subfield; a short first member is left to inflate()
+    // to find fault with.
+
+    z->format = zf_raw;
+    if (rawscan_zframes_fill(z, 4) == 0) {
+        magic = (const unsigned char *)z->stage;
+        if (memcmp(magic, zstd_magic, 4) == 0) {
+            z->format = zf_zstd;
+        } else if (magic[0] == 0x1f && magic[1] == 0x8b) {
+            z->format = zf_gzip;
+            if ((magic[3] & 4) && rawscan_zframes_fill(z, 12) == 0) {
+                size_t xlen = rawscan_get_le16(z->stage + 10);
+
+                if (rawscan_zframes_fill(z, 12 + xlen) == 0 &&
+                        rawscan_bgzf_bsize(z->stage, xlen) != 0)
+                    z->format = zf_bgzf;
+            }
+        }
+    }
+    z->read_eof = false;
+    z->input_errnum = 0;
+
+    if (((z->format == zf_bgzf || z->format == zf_gzip) && !RAWSCAN_WITH_ZLIB) ||
+                        (z->format == zf_zstd && !RAWSCAN_WITH_ZSTD)) {
+        errno = ENOTSUP;
+        goto fail;
+    }
+
+#if RAWSCAN_WITH_ZLIB
+    if (z->format == zf_gzip) {
+        if (inflateInit2(&z->gz, 16 + MAX_WBITS) != Z_OK) {
+            errno = ENOMEM;
+            goto fail;
+        }
+        z->gz_ready = true;
+    }
+#endif
+
+    if (z->format == zf_bgzf || z->format == zf_zstd) {
+        z->nslots = 4 * nthreads;
+        if ((z->slots = calloc(z->nslots, sizeof(*z->slots))) == NULL)
+            goto fail;
+        if ((threads = calloc(nthreads, sizeof(*threads))) == NULL)
+            goto fail;
+        pthread_mutex_init(&z->lock, NULL);
+        pthread_cond_init(&z->work_cv, NULL);
+        pthread_cond_init(&z->done_cv, NULL);
+        z->threads = threads;
+        for (z->nthreads = 0; z->nthreads < nthreads; z->nthreads++) {
+            if (pthread_create(&z->threads[z->nthreads], NULL,
+                                        rawscan_zframes_worker, z) != 0) {
+                if (z->nthreads == 0) {
+                    errno = EAGAIN;
+                    goto fail;
+                }
+                break;                          // make do with fewer
+            }
+        }
+    }
+
+    if ((rsp = rs_open_reader(rawscan_zframes_read, z, bufsz,
+                                            delimiterbyte)) == NULL)
+        goto fail;
+    rsp->fd = fd;
+    rsp->closer = rawscan_zframes_close;
+
+    return rsp;
+
+  fail:
+    rawscan_zframes_close(z);
+    return NULL;
+}
+
+/*
+ * rs_open_files(): scan a list of files as one stream.
+ *
+ * Jobs that scan thousands of rotated log files would otherwise
+ * pay for an rs_open() and a fresh buffer per file, and would wait
+ * on a cold page cache at the start of each file.  Here one buffer
+ * is reused across all the files, and while each file is being
+ * scanned, the next file is already open, with posix_fadvise()
+ * having asked the kernel to start reading ahead its first
+ * RAWSCAN_PREFETCH_BYTES bytes.
+ *
+ * Unlike cat(1), a file's final line, if not ended with a
+ * delimiterbyte, is not joined with the first line of the next file.
+ * It is returned as rt_full_line_without_eol (or as the end of a
+ * long line), the same as the final line of a single file would be.
+ *
+ * rs_get_file_index() tells which file the most recently returned
+ * line (or chunk) came from.  This is exact, because the next file
+ * isn't read until every byte of the current file has been returned,
+ * or peeked by rs_peekline(); a peek into the next file leaves the
+ * index at that of the line returned before it, until rs_getline()
+ * returns the peeked line.
+ *
+ * If some file after the first can't be opened, rs_getline() returns
+ * rt_err, with rs_get_file_index() giving that file's index.
+ *
+ * The paths, both the array and the strings, are copied, so the
+ * caller may free or reuse them once rs_open_files() returns.
+ */
+
+#ifndef RAWSCAN_PREFETCH_BYTES
+#define RAWSCAN_PREFETCH_BYTES (2*1024*1024)
+#endif
+
+typedef struct rawscan_files {
+    const char **paths;     // copy of caller's paths, strings and all
+    size_t npaths;
+    size_t cur;             // index of file now open on rsp->fd
+    size_t returned;        // index of file of last result returned
+    int next_fd;            // paths[cur+1], opened and prefetched, or -1
+} rawscan_files;
+
+// rs_getline_morecode() returned a result, from the current file.
+
+static void rawscan_files_returned(RAWSCAN *rsp)
+{
+    rsp->files->returned = rsp->files->cur;
+}
+
+// A peek returned a result, from file_index or after it, that isn't
+// returned to the caller yet: the last returned result is still from
+// file_index.
+
+static void rawscan_files_unreturned(RAWSCAN *rsp, size_t file_index)
+{
+    rsp->files->returned = file_index;
+}
+
+// Open paths[i] and ask the kernel to start reading it in.
+
+static int rawscan_open_prefetch(rawscan_files *f, size_t i)
+{
+    int fd;
+
+    if ((fd = open(f->paths[i], O_RDONLY)) < 0)
+        return -1;
+    (void) posix_fadvise(fd, 0, RAWSCAN_PREFETCH_BYTES, POSIX_FADV_WILLNEED);
+    (void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+}
+
+// At end of current file: switch rsp->fd to the next file and
+// clear eof_seen.  Return false if no more files, or if the next
+// file can't be opened (setting err_seen, errnum).
+
+static bool rawscan_next_file(RAWSCAN *rsp)
+{
+    rawscan_files *f = rsp->files;
+    int fd;
+
+    if (f->cur + 1 >= f->npaths)
+        return false;
+
+    close(rsp->fd);
+    rsp->fd = -1;
+    f->cur++;
+
+    if ((fd = f->next_fd) < 0 && (fd = rawscan_open_prefetch(f, f->cur)) < 0) {
+        rsp->errnum = errno;
+        rsp->err_seen = true;
+        f->npaths = f->cur;                     // no going further
+        return false;
+    }
+    rsp->fd = fd;
+    rsp->eof_seen = false;
+
+    // Get the next file's first pages on their way in, while we
+    // scan this one.  If it won't open, report that when we get to it.
+    f->next_fd = -1;
+    if (f->cur + 1 < f->npaths)
+        f->next_fd = rawscan_open_prefetch(f, f->cur + 1);
+
+    return true;
+}
+
+static void rawscan_files_close(void *arg)
+{
+    RAWSCAN *rsp = arg;
+    rawscan_files *f = rsp->files;
+
+    if (rsp->fd >= 0)
+        close(rsp->fd);
+    if (f->next_fd >= 0)
+        close(f->next_fd);
+    rsp->fd = -1;
+    rsp->files = NULL;
+    free(f->paths);
+    free(f);
+}
+
+__unused__ func_static RAWSCAN *rs_open_files (
+  const char *const paths[], // files to read, in order
+  size_t npaths,             // how many paths
+  size_t bufsz,              // handle lines at least this many bytes in one chunk
+  char delimiterbyte)        // newline '\n' or other char marking end of "lines"
+{
+    rawscan_files *f;
+    RAWSCAN *rsp;
+    size_t i, strsz = 0;
+    char *str;
+    int fd = -1;
+
+    if ((f = calloc(1, sizeof(*f))) == NULL)
+        return NULL;
+
+    // One allocation for the array and the strings it points to,
+    // so the caller's paths needn't outlive this call.
+    for (i = 0; i < npaths; i++)
+        strsz += strlen(paths[i]) + 1;
+    if ((f->paths = malloc((npaths ? npaths : 1) * sizeof(*f->paths)
+                           + strsz)) == NULL)
+        goto fail;
+    str = (char *)(f->paths + (npaths ? npaths : 1));
+    for (i = 0; i < npaths; i++) {
+        size_t len = strlen(paths[i]) + 1;
+
+        memcpy(str, paths[i], len);
+        f->paths[i] = str;
+        str += len;
+    }
+    f->npaths = npaths;
+    f->next_fd = -1;
+
+    if (npaths > 0 && (fd = rawscan_open_prefetch(f, 0)) < 0)
+        goto fail;
+    if (npaths > 1)
+        f->next_fd = rawscan_open_prefetch(f, 1);
+
+    if ((rsp = rs_open(fd, bufsz, delimiterbyte)) == NULL)
+        goto fail;
+    rsp->files = f;
+    rsp->reader_arg = rsp;
+    rsp->closer = rawscan_files_close;
+    if (npaths == 0)
+        rsp->eof_seen = true;                   // empty list: empty stream
+
+    return rsp;
+
+  fail:
+    if (fd >= 0)
+        close(fd);
+    if (f->next_fd >= 0)
+        close(f->next_fd);
+    free(f->paths);
+    free(f);
+    return NULL;
+}
+
+__unused__ func_static size_t rs_get_file_index(RAWSCAN *rsp)
+{
+    return rsp->files != NULL ? rsp->files->returned : 0;
+}
+
+/*
+ * rs_dirscan(): parallel recursive directory scanner.
+ *
+ * Replaces "find dirs -type f | xargs grep" pipelines with one
+ * process keeping all cpus busy.  Worker threads share a stack
+ * of pending directories and files.  A worker popping a directory
+ * reads it with getdents64(2), a few dozen entries per system
+ * call, pushing its subdirectories and regular files back onto
+ * the stack.  A worker popping a file scans it with rs_getline(),
+ * using the one RAWSCAN buffer that worker rs_reopen()'s for every
+ * file it scans.  Those streams are all taken from the stream pool up
+ * front, on the calling thread, as rs_open() isn't thread safe (it
+ * moves the data break with brk(2)).
+ *
+ * Each line for which the caller's match() routine returns true
+ * is written as "path:line" (with a delimiterbyte appended if the
+ * line lacked one).  Lines too long for the buffer are tested on
+ * their first chunk, and if that matches, all chunks are written.
+ * Output is staged per thread and written once per file, so the
+ * matches from any one file stay together, unless they exceed
+ * RAWSCAN_DIRSCAN_OUTBUF bytes, which forces an earlier write.
+ *
+ * Symbolic links found while walking are not followed (roots are).
+ * Files and directories that can't be opened or read are skipped,
+ * as "grep -rs" would.
+ */
+
+#ifndef RAWSCAN_DIRSCAN_OUTBUF
+#define RAWSCAN_DIRSCAN_OUTBUF (64*1024)
+#endif
+
+// <dirent.h> only defines these for _DEFAULT_SOURCE; Linux values:
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN  0
+#define DT_DIR      4
+#define DT_REG      8
+#endif
+
+struct rawscan_linux_dirent64 {         // as returned by getdents64(2)
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct rawscan_dirscan_item {
+    struct rawscan_dirscan_item *next;
+    bool isdir;
+    char path[];                        // nul-terminated
+};
+
+typedef struct rawscan_dirscan {
+    pthread_mutex_t lock;               // protects stack, busy, nmatched
+    pthread_cond_t cv;                  // wait for work, or for all done
+    struct rawscan_dirscan_item *stack; // pending dirs and files
+    int busy;                           // workers now handling an item
+    long nmatched;                      // count of matching lines
+
+    pthread_mutex_t outlock;            // serializes writes to outfd
+    int outfd;
+
+    rs_line_match_fn match;
+    void *arg;
+} rawscan_dirscan;
+
+typedef struct rawscan_dirscan_worker {
+    rawscan_dirscan *ds;
+    RAWSCAN *rsp;                       // reused for each file scanned
+    char *out;                          // staged "path:line" output
+    size_t outlen, outcap;
+    long nmatched;
+} rawscan_dirscan_worker;
+
+static struct rawscan_dirscan_item *rawscan_dirscan_item(
+                const char *dir, const char *name, bool isdir)
+{
+    size_t dirlen = dir ? strlen(dir) : 0;
+    size_t namelen = strlen(name);
+    struct rawscan_dirscan_item *it;
+
+    if ((it = malloc(sizeof(*it) + dirlen + 1 + namelen + 1)) == NULL)
+        return NULL;
+    it->isdir = isdir;
+    if (dir != NULL) {
+        memcpy(it->path, dir, dirlen);
+        if (dirlen == 0 || dir[dirlen - 1] != '/')
+            it->path[dirlen++] = '/';
+    }
+    memcpy(it->path + dirlen, name, namelen + 1);
+    return it;
+}
+
+static void rawscan_dirscan_push(rawscan_dirscan *ds,
+                struct rawscan_dirscan_item *first,
+                struct rawscan_dirscan_item *last)
+{
+    pthread_mutex_lock(&ds->lock);
+    last->next = ds->stack;
+    ds->stack = first;
+    pthread_cond_broadcast(&ds->cv);
+    pthread_mutex_unlock(&ds->lock);
+}
+
+static void rawscan_dirscan_dir(rawscan_dirscan *ds, const char *path)
+{
+    struct rawscan_dirscan_item *first = NULL, *last = NULL;
+    char dbuf[32*1024];
+    long nread;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return;
+
+    while ((nread = syscall(SYS_getdents64, fd, dbuf, sizeof(dbuf))) > 0) {
+        long off;
+
+        for (off = 0; off < nread; ) {
+            struct rawscan_linux_dirent64 *d =
+                        (struct rawscan_linux_dirent64 *)(dbuf + off);
+            struct rawscan_dirscan_item *it;
+            unsigned char type = d->d_type;
+
+            off += d->d_reclen;
+            if (d->d_name[0] == '.' && (d->d_name[1] == '\0' ||
+                        (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+                continue;
+            if (type != DT_DIR && type != DT_REG && type != DT_UNKNOWN)
+                continue;
+            if ((it = rawscan_dirscan_item(path, d->d_name,
+                                            type == DT_DIR)) == NULL)
+                continue;
+            if (type == DT_UNKNOWN) {           // file system didn't say
+                struct stat st;
+
+                if (lstat(it->path, &st) < 0 ||
+                        (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))) {
+                    free(it);
+                    continue;
+                }
+                it->isdir = S_ISDIR(st.st_mode);
+            }
+            it->next = first;
+            first = it;
+            if (last == NULL)
+                last = it;
+        }
+    }
+    close(fd);
+
+    if (first != NULL)
+        rawscan_dirscan_push(ds, first, last);
+}
+
+// Write all of p[0..left) to outfd; caller holds outlock.
+
+static void rawscan_dirscan_write(rawscan_dirscan *ds, const char *p,
+                size_t left)
+{
+    while (left > 0) {
+        ssize_t cnt = write(ds->outfd, p, left);
+
+        if (cnt <= 0 && errno != EINTR)
+            break;                              // output lost; keep going
+        if (cnt > 0) {
+            p += cnt;
+            left -= cnt;
+        }
+    }
+}
+
+static void rawscan_dirscan_flush(rawscan_dirscan_worker *w)
+{
+    pthread_mutex_lock(&w->ds->outlock);
+    rawscan_dirscan_write(w->ds, w->out, w->outlen);
+    pthread_mutex_unlock(&w->ds->outlock);
+    w->outlen = 0;
+}
+
+static void rawscan_dirscan_emit(rawscan_dirscan_worker *w, const char *path,
+                const char *begin, size_t len, bool with_path, bool add_eol)
+{
+    size_t pathlen = with_path ? strlen(path) + 1 : 0;
+    size_t need = pathlen + len + add_eol;
+
+    if (w->outlen + need > w->outcap) {
+        if (w->outlen > 0)
+            rawscan_dirscan_flush(w);
+        if (need > w->outcap) {                 // huge chunk: grow buffer
+            char *newout = realloc(w->out, need);
+
+            if (newout == NULL) {               // can't: write it direct
+                pthread_mutex_lock(&w->ds->outlock);
+                if (with_path) {
+                    rawscan_dirscan_write(w->ds, path, pathlen - 1);
+                    rawscan_dirscan_write(w->ds, ":", 1);
+                }
+                rawscan_dirscan_write(w->ds, begin, len);
+                if (add_eol)
+                    rawscan_dirscan_write(w->ds,
+                                    &w->rsp->delimiterbyte, 1);
+                pthread_mutex_unlock(&w->ds->outlock);
+                return;
+            }
+            w->out = newout;
+            w->outcap = need;
+        }
+    }
+    if (with_path) {
+        memcpy(w->out + w->outlen, path, pathlen - 1);
+        w->out[w->outlen + pathlen - 1] = ':';
+        w->outlen += pathlen;
+    }
+    memcpy(w->out + w->outlen, begin, len);
+    w->outlen += len;
+    if (add_eol)
+        w->out[w->outlen++] = w->rsp->delimiterbyte;
+}
+
+static void rawscan_dirscan_file(rawscan_dirscan_worker *w, const char *path)
+{
+    RAWSCAN *rsp = w->rsp;
+    bool good_long_line = false;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return;
+    rs_reopen(rsp, fd);
+
+    for (;;) {
+        RAWSCAN_RESULT rt = rs_getline(rsp);
+        size_t len;
+
+        switch (rt.type) {
+            case rt_full_line:
+            case rt_full_line_without_eol:
+                len = rt.line.end - rt.line.begin + 1;
+                if (w->ds->match(w->ds->arg, rt.line.begin, rt.line.end)) {
+                    rawscan_dirscan_emit(w, path, rt.line.begin, len, true,
+                                    rt.type == rt_full_line_without_eol);
+                    w->nmatched++;
+                }
+                break;
+            case rt_start_longline:
+                good_long_line = w->ds->match(w->ds->arg,
+                                        rt.line.begin, rt.line.end);
+                if (good_long_line)
+                    w->nmatched++;
+                len = rt.line.end - rt.line.begin + 1;
+                if (good_long_line)
+                    rawscan_dirscan_emit(w, path, rt.line.begin, len,
+                                                        true, false);
+                break;
+            case rt_within_longline:
+                len = rt.line.end - rt.line.begin + 1;
+                if (good_long_line)
+                    rawscan_dirscan_emit(w, path, rt.line.begin, len, false,
+                                    *rt.line.end != rsp->delimiterbyte &&
+                                    rsp->eof_seen && rsp->p == rsp->q);
+                break;
+            case rt_longline_ended:
+                good_long_line = false;
+                break;
+            case rt_paused:
+                break;
+            case rt_eof:
+            case rt_err:
+            default:
+                close(fd);
+                if (w->outlen > 0)
+                    rawscan_dirscan_flush(w);
+                return;
+        }
+    }
+}
+
+static void *rawscan_dirscan_thread(void *arg)
+{
+    rawscan_dirscan_worker *w = arg;
+    rawscan_dirscan *ds = w->ds;
+
+    pthread_mutex_lock(&ds->lock);
+    for (;;) {
+        struct rawscan_dirscan_item *it;
+
+        while (ds->stack == NULL && ds->busy > 0)
+            pthread_cond_wait(&ds->cv, &ds->lock);
+        if ((it = ds->stack) == NULL)
+            break;                              // nothing left anywhere
+        ds->stack = it->next;
+        ds->busy++;
+        pthread_mutex_unlock(&ds->lock);
+
+        if (it->isdir)
+            rawscan_dirscan_dir(ds, it->path);
+        else
+            rawscan_dirscan_file(w, it->path);
+        free(it);
+
+        pthread_mutex_lock(&ds->lock);
+        if (--ds->busy == 0 && ds->stack == NULL)
+            pthread_cond_broadcast(&ds->cv);
+    }
+    ds->nmatched += w->nmatched;
+    pthread_mutex_unlock(&ds->lock);
+    return NULL;
+}
+
+__unused__ func_static long rs_dirscan (
+  const char *const roots[], // directories (or files) to scan
+  size_t nroots,             // how many roots
+  int nthreads,              // number of scanning threads (<= 0: ncpus)
+  size_t bufsz,              // main input buffer size, per thread
+  char delimiterbyte,        // newline '\n' or other char marking end of "lines"
+  rs_line_match_fn match,    // select lines to output
+  void *arg,                 // passed unchanged to each match() call
+  int outfd)                 // write matching lines here
+{
+    rawscan_dirscan ds;
+    rawscan_dirscan_worker *workers;
+    pthread_t *threads;
+    size_t i;
+    int t, nstarted;
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+
+    memset(&ds, 0, sizeof(ds));
+    ds.outfd = outfd;
+    ds.match = match;
+    ds.arg = arg;
+
+    for (i = nroots; i-- > 0; ) {
+        struct rawscan_dirscan_item *it;
+        struct stat st;
+
+        if (stat(roots[i], &st) < 0)
+            continue;
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))
+            continue;
+        if ((it = rawscan_dirscan_item(NULL, roots[i],
+                                        S_ISDIR(st.st_mode))) == NULL)
+            goto fail;
+        it->next = ds.stack;
+        ds.stack = it;
+    }
+
+    workers = calloc(nthreads, sizeof(*workers));
+    threads = calloc(nthreads, sizeof(*threads));
+    if (workers == NULL || threads == NULL)
+        goto fail_free;
+    for (t = 0; t < nthreads; t++) {
+        workers[t].ds = &ds;
+        workers[t].outcap = RAWSCAN_DIRSCAN_OUTBUF;
+        if ((workers[t].out = malloc(workers[t].outcap)) == NULL)
+            goto fail_free;
+        if ((workers[t].rsp = rawscan_pool_get(-1, bufsz,
+                                               delimiterbyte)) == NULL)
+            goto fail_free;
+    }
+
+    pthread_mutex_init(&ds.lock, NULL);
+    pthread_cond_init(&ds.cv, NULL);
+    pthread_mutex_init(&ds.outlock, NULL);
+
+    for (nstarted = 0; nstarted < nthreads; nstarted++)
+        if (pthread_create(&threads[nstarted], NULL,
+                            rawscan_dirscan_thread, &workers[nstarted]) != 0)
+            break;
+    if (nstarted == 0)                          // do it ourselves
+        rawscan_dirscan_thread(&workers[0]);
+    for (t = 0; t < nstarted; t++)
+        pthread_join(threads[t], NULL);
+
+    pthread_mutex_destroy(&ds.outlock);
+    pthread_cond_destroy(&ds.cv);
+    pthread_mutex_destroy(&ds.lock);
+
+    for (t = 0; t < nthreads; t++) {
+        rawscan_pool_put(workers[t].rsp);
+        free(workers[t].out);
+    }
+    free(workers);
+    free(threads);
+    return ds.nmatched;
+
+  fail_free:
+    if (workers != NULL) {
+        for (t = 0; t < nthreads; t++) {
+            if (workers[t].rsp != NULL)
+                rawscan_pool_put(workers[t].rsp);
+            free(workers[t].out);
+        }
+    }
+    free(workers);
+    free(threads);
+  fail:
+    while (ds.stack != NULL) {
+        struct rawscan_dirscan_item *it = ds.stack;
+
+        ds.stack = it->next;
+        free(it);
+    }
+    errno = ENOMEM;
+    return -1;
+}
+
+/*
+ * rs_bulk_open(), rs_bulk_next(): open and read many small files.
+ *
+ * For directories full of 1 to 64 KByte files, the cost is in the
+ * open, read, read (to see EOF) and close system calls, not in the
+ * scanning.  Here we keep "depth" files in flight through an
+ * io_uring: an openat for each file, then, as each open completes,
+ * a read directly into the buffer of one of a pool of "depth"
+ * RAWSCAN streams, whose buffers are registered with the ring as
+ * fixed buffers, then, as each read completes, a close.  Many such
+ * operations are submitted, and many completions reaped, in each
+ * io_uring_enter(2) call.
+ *
+ * rs_bulk_next() returns streams in the order their reads complete,
+ * with their first bufsz bytes (or the whole file, if smaller)
+ * already in the buffer, so that scanning them makes no further
+ * system calls.  A read shorter than bufsz is taken as reaching the
+ * end of the file, which holds for regular files.  A file that fills
+ * the whole buffer is left open, positioned after the bytes read,
+ * and its stream reads the rest with read(2) as usual.
+ *
+ * A stream for a file that couldn't be opened or read returns rt_err,
+ * with that errno, on its first rs_getline().  rs_bulk_file_index()
+ * gives the index in paths[] of the file last returned.
+ *
+ * Each stream returned is only valid until the next rs_bulk_next()
+ * call, which recycles its buffer for another file.  The "depth"
+ * streams are from the stream pool.
+ */
+
+#ifndef RAWSCAN_BULK_DEPTH
+#define RAWSCAN_BULK_DEPTH 64
+#endif
+
+#ifndef AT_FDCWD
+#define AT_FDCWD -100                   // Linux value, if <fcntl.h> hides it
+#endif
+
+enum rawscan_bulk_state {
+    bs_free,                // no file assigned
+    bs_opening,             // openat submitted
+    bs_reading,             // read submitted
+    bs_ready,               // on ready queue, awaiting rs_bulk_next()
+    bs_returned,            // returned by last rs_bulk_next()
+};
+
+enum rawscan_bulk_op { bo_open, bo_read, bo_close };
+
+struct rawscan_bulk_slot {
+    RAWSCAN *rsp;           // pool stream, its buffer reused per file
+    enum rawscan_bulk_state state;
+    size_t pathidx;         // which paths[] entry
+    int fd;                 // open fd, if still open, else -1
+};
+
+#if RAWSCAN_WITH_IO_URING
+struct rawscan_uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz, sqes_sz;
+    unsigned sq_entries;
+    unsigned to_submit;     // sqes queued since last io_uring_enter
+    bool fixed_bufs;        // pool buffers registered: use READ_FIXED
+};
+#endif
+
+struct RAWSCAN_BULK {
+    const char **paths;     // copy of caller's paths, strings and all
+    size_t npaths;
+    size_t nextpath;        // next paths[] entry to start on
+
+    struct rawscan_bulk_slot *slots;
+    unsigned nslots;
+    unsigned *readyq;       // FIFO of slot indices in bs_ready
+    unsigned readyhead, readytail;
+    unsigned inflight;      // slots in bs_opening or bs_reading
+    long returned;          // slot returned by last rs_bulk_next, or -1
+
+#if RAWSCAN_WITH_IO_URING
+    struct rawscan_uring ring;
+#endif
+    bool use_ring;          // else plain system calls
+};
+
+// Load the first "len" bytes of a file, just read into the buffer
+// by other means, into the stream's state.  A rs_set_transform() map,
+// kept by rs_reopen(), is applied here, as rawscan_read() would.
+
+static void rawscan_bulk_loaded(RAWSCAN *rsp, int fd, size_t len, bool eof)
+{
+    rs_reopen(rsp, fd);
+    if (rsp->xform != NULL)
+        rawscan_xform_apply(rsp->xform, (char *)rsp->buf, len);
+    rsp->p = rsp->buf;
+    rsp->q = rsp->buf + len;
+    if (rsp->q < rsp->buftop)                   // as in rawscan_read()
+        *(char *)(rsp->q) = rsp->delimiterbyte;
+    rsp->eof_seen = eof;
+}
+
+static void rawscan_bulk_failed(RAWSCAN *rsp, int errnum)
+{
+    rs_reopen(rsp, -1);
+    rsp->errnum = errnum;
+    rsp->err_seen = true;
+}
+
+static void rawscan_bulk_ready(RAWSCAN_BULK *bp, unsigned slotidx)
+{
+    bp->slots[slotidx].state = bs_ready;
+    bp->readyq[bp->readytail++ % bp->nslots] = slotidx;
+}
+
+#if RAWSCAN_WITH_IO_URING
+
+static int rawscan_uring_setup(struct rawscan_uring *r, unsigned entries)
+{
+    struct io_uring_params params;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    if ((fd = syscall(SYS_io_uring_setup, entries, &params)) < 0)
+        return -1;
+
+    r->fd = fd;
+    r->sq_entries = params.sq_entries;
+    r->sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_ring_sz = params.cq_off.cqes +
+                        params.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ|PROT_WRITE,
+                            MAP_SHARED, fd, IORING_OFF_SQ_RING);
+    r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ|PROT_WRITE,
+                            MAP_SHARED, fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_sz, PROT_READ|PROT_WRITE,
+                            MAP_SHARED, fd, IORING_OFF_SQES);
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+                                        r->sqes == MAP_FAILED) {
+        if (r->sq_ring != MAP_FAILED)
+            munmap(r->sq_ring, r->sq_ring_sz);
+        if (r->cq_ring != MAP_FAILED)
+            munmap(r->cq_ring, r->cq_ring_sz);
+        if (r->sqes != MAP_FAILED)
+            munmap(r->sqes, r->sqes_sz);
+        close(fd);
+        return -1;
+    }
+
+#   define RingPtr(ring, off) ((unsigned *)((char *)(ring) + (off)))
+    r->sq_head = RingPtr(r->sq_ring, params.sq_off.head);
+    r->sq_tail = RingPtr(r->sq_ring, params.sq_off.tail);
+    r->sq_mask = RingPtr(r->sq_ring, params.sq_off.ring_mask);
+    r->sq_array = RingPtr(r->sq_ring, params.sq_off.array);
+    r->cq_head = RingPtr(r->cq_ring, params.cq_off.head);
+    r->cq_tail = RingPtr(r->cq_ring, params.cq_off.tail);
+    r->cq_mask = RingPtr(r->cq_ring, params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ring + params.cq_off.cqes);
+#   undef RingPtr
+
+    r->to_submit = 0;
+    return 0;
+}
+
+static void rawscan_uring_teardown(struct rawscan_uring *r)
+{
+    munmap(r->sqes, r->sqes_sz);
+    munmap(r->cq_ring, r->cq_ring_sz);
+    munmap(r->sq_ring, r->sq_ring_sz);
+    close(r->fd);
+}
+
+static int rawscan_uring_enter(struct rawscan_uring *r, unsigned min_complete)
+{
+    int ret;
+
+    do {
+        ret = syscall(SYS_io_uring_enter, r->fd, r->to_submit, min_complete,
+                        min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret >= 0)
+        r->to_submit -= (unsigned)ret < r->to_submit ? (unsigned)ret
+                                                     : r->to_submit;
+    return ret;
+}
+
+// Return next free sqe, submitting what's queued if the ring is full.
+
+static struct io_uring_sqe *rawscan_uring_sqe(struct rawscan_uring *r)
+{
+    unsigned tail = *r->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE)
+                                                    >= r->sq_entries)
+        if (rawscan_uring_enter(r, 0) < 0)
+            return NULL;
+
+    sqe = &r->sqes[tail & *r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[tail & *r->sq_mask] = tail & *r->sq_mask;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return sqe;
+}
+
+// Does the running kernel support every opcode we submit?  Those,
+// and IORING_REGISTER_PROBE itself, all came in Linux 5.6; earlier
+// kernels with io_uring fail the probe, so they get plain syscalls.
+
+static bool rawscan_uring_probe(struct rawscan_uring *r)
+{
+    static const unsigned char need[] = {
+        IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED,
+        IORING_OP_CLOSE,
+    };
+    union {
+        struct io_uring_probe probe;
+        char space[sizeof(struct io_uring_probe) +
+                        256 * sizeof(struct io_uring_probe_op)];
+    } p;
+    unsigned i;
+
+    memset(&p, 0, sizeof(p));
+    if (syscall(SYS_io_uring_register, r->fd, IORING_REGISTER_PROBE,
+                                                        &p.probe, 256) < 0)
+        return false;
+    for (i = 0; i < sizeof(need); i++)
+        if (need[i] > p.probe.last_op ||
+                !(p.probe.ops[need[i]].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    return true;
+}
+
+static void rawscan_bulk_sync(RAWSCAN_BULK *bp, unsigned slotidx);
+
+#define rawscan_bulk_udata(slotidx, op) (((uint64_t)(slotidx) << 2) | (op))
+
+static void rawscan_bulk_submit_open(RAWSCAN_BULK *bp, unsigned slotidx)
+{
+    struct rawscan_bulk_slot *slot = &bp->slots[slotidx];
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = rawscan_uring_sqe(&bp->ring)) == NULL) {
+        rawscan_bulk_failed(slot->rsp, errno);
+        rawscan_bulk_ready(bp, slotidx);
+        return;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)bp->paths[slot->pathidx];
+    sqe->open_flags = O_RDONLY;
+    sqe->user_data = rawscan_bulk_udata(slotidx, bo_open);
+    slot->state = bs_opening;
+    bp->inflight++;
+}
+
+static void rawscan_bulk_submit_read(RAWSCAN_BULK *bp, unsigned slotidx)
+{
+    struct rawscan_bulk_slot *slot = &bp->slots[slotidx];
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = rawscan_uring_sqe(&bp->ring)) == NULL) {
+        rawscan_bulk_failed(slot->rsp, errno);
+        close(slot->fd);
+        slot->fd = -1;
+        bp->inflight--;
+        rawscan_bulk_ready(bp, slotidx);
+        return;
+    }
+    sqe->opcode = bp->ring.fixed_bufs ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uintptr_t)slot->rsp->buf;
+    sqe->len = slot->rsp->bufsz;
+    sqe->off = 0;
+    sqe->buf_index = slotidx;
+    sqe->user_data = rawscan_bulk_udata(slotidx, bo_read);
+    slot->state = bs_reading;
+}
+
+// Close fd through the ring; nobody waits for the completion.
+
+static void rawscan_bulk_submit_close(RAWSCAN_BULK *bp, int fd)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = rawscan_uring_sqe(&bp->ring)) == NULL) {
+        close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = rawscan_bulk_udata(0, bo_close);
+}
+
+static void rawscan_bulk_complete(RAWSCAN_BULK *bp, uint64_t udata, int res)
+{
+    unsigned slotidx = udata >> 2;
+    struct rawscan_bulk_slot *slot = &bp->slots[slotidx];
+
+    switch ((enum rawscan_bulk_op)(udata & 3)) {
+        case bo_open:
+            if (res == -EINVAL) {
+                // Ring refused the openat: do this one by hand.
+                bp->inflight--;
+                rawscan_bulk_sync(bp, slotidx);
+            } else if (res < 0) {
+                rawscan_bulk_failed(slot->rsp, -res);
+                bp->inflight--;
+                rawscan_bulk_ready(bp, slotidx);
+            } else {
+                slot->fd = res;
+                rawscan_bulk_submit_read(bp, slotidx);
+            }
+            break;
+        case bo_read:
+            bp->inflight--;
+            if (res < 0) {
+                rawscan_bulk_failed(slot->rsp, -res);
+                rawscan_bulk_submit_close(bp, slot->fd);
+                slot->fd = -1;
+            } else if ((size_t)res < slot->rsp->bufsz) {
+                rawscan_bulk_loaded(slot->rsp, -1, res, true);
+                rawscan_bulk_submit_close(bp, slot->fd);
+                slot->fd = -1;
+            } else {
+                // Whole buffer filled; rest of file left for read(2).
+                (void) lseek(slot->fd, res, SEEK_SET);
+                rawscan_bulk_loaded(slot->rsp, slot->fd, res, false);
+            }
+            rawscan_bulk_ready(bp, slotidx);
+            break;
+        case bo_close:
+            break;
+    }
+}
+
+static void rawscan_bulk_reap(RAWSCAN_BULK *bp)
+{
+    struct rawscan_uring *r = &bp->ring;
+    unsigned head = *r->cq_head;
+
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+
+        rawscan_bulk_complete(bp, cqe->user_data, cqe->res);
+        head++;
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+#endif /* RAWSCAN_WITH_IO_URING */
+
+// Without a ring: open and read paths[slot->pathidx] right now.
+
+static void rawscan_bulk_sync(RAWSCAN_BULK *bp, unsigned slotidx)
+{
+    struct rawscan_bulk_slot *slot = &bp->slots[slotidx];
+    RAWSCAN *rsp = slot->rsp;
+    ssize_t cnt;
+    int fd;
+
+    if ((fd = open(bp->paths[slot->pathidx], O_RDONLY)) < 0) {
+        rawscan_bulk_failed(rsp, errno);
+    } else if ((cnt = read(fd, (void *)rsp->buf, rsp->bufsz)) < 0) {
+        rawscan_bulk_failed(rsp, errno);
+        close(fd);
+    } else if ((size_t)cnt < rsp->bufsz) {
+        rawscan_bulk_loaded(rsp, -1, cnt, true);
+        close(fd);
+    } else {
+        rawscan_bulk_loaded(rsp, fd, cnt, false);
+        slot->fd = fd;
+    }
+    rawscan_bulk_ready(bp, slotidx);
+}
+
+__unused__ func_static RAWSCAN *rs_bulk_next(RAWSCAN_BULK *bp)
+{
+    unsigned i;
+
+    // Recycle the stream returned last time.
+    if (bp->returned >= 0) {
+        struct rawscan_bulk_slot *slot = &bp->slots[bp->returned];
+
+        if (slot->fd >= 0) {
+#if RAWSCAN_WITH_IO_URING
+            if (bp->use_ring)
+                rawscan_bulk_submit_close(bp, slot->fd);
+            else
+#endif
+                close(slot->fd);
+            slot->fd = -1;
+        }
+        slot->state = bs_free;
+        bp->returned = -1;
+    }
+
+    for (;;) {
+        // Start more files on free slots.
+        for (i = 0; i < bp->nslots && bp->nextpath < bp->npaths; i++) {
+            if (bp->slots[i].state != bs_free)
+                continue;
+            bp->slots[i].pathidx = bp->nextpath++;
+#if RAWSCAN_WITH_IO_URING
+            if (bp->use_ring) {
+                rawscan_bulk_submit_open(bp, i);
+                continue;
+            }
+#endif
+            rawscan_bulk_sync(bp, i);
+            break;                              // one at a time, if sync
+        }
+
+        if (bp->readyhead != bp->readytail) {
+            i = bp->readyq[bp->readyhead++ % bp->nslots];
+            bp->slots[i].state = bs_returned;
+            bp->returned = i;
+            return bp->slots[i].rsp;
+        }
+
+        if (bp->inflight == 0)
+            return NULL;                        // all done
+
+#if RAWSCAN_WITH_IO_URING
+        // Submit all queued sqes, and wait for at least one completion.
+        if (rawscan_uring_enter(&bp->ring, 1) < 0)
+            return NULL;
+        rawscan_bulk_reap(bp);
+#endif
+    }
+}
+
+__unused__ func_static size_t rs_bulk_file_index(RAWSCAN_BULK *bp)
+{
+    return bp->returned >= 0 ? bp->slots[bp->returned].pathidx : 0;
+}
+
+__unused__ func_static void rs_bulk_close(RAWSCAN_BULK *bp)
+{
+    unsigned i;
+
+#if RAWSCAN_WITH_IO_URING
+    if (bp->use_ring) {
+        // Let in flight opens and reads finish, so the kernel is
+        // done with our paths and buffers, then close their fds.
+        while (bp->inflight > 0 && rawscan_uring_enter(&bp->ring, 1) >= 0) {
+            bp->nextpath = bp->npaths;
+            rawscan_bulk_reap(bp);
+        }
+        rawscan_uring_enter(&bp->ring, 0);
+        rawscan_uring_teardown(&bp->ring);
+    }
+#endif
+    for (i = 0; i < bp->nslots; i++) {
+        if (bp->slots[i].fd >= 0)
+            close(bp->slots[i].fd);
+        rawscan_pool_put(bp->slots[i].rsp);
+    }
+    free(bp->readyq);
+    free(bp->slots);
+    free(bp->paths);
+    free(bp);
+}
+
+__unused__ func_static RAWSCAN_BULK *rs_bulk_open (
+  const char *const paths[], // files to read
+  size_t npaths,             // how many paths
+  size_t bufsz,              // main input buffer size, per stream
+  char delimiterbyte,        // newline '\n' or other char marking end of "lines"
+  unsigned depth)            // how many files in flight at once (0: default)
+{
+    RAWSCAN_BULK *bp;
+    unsigned i;
+
+    if (depth == 0)
+        depth = RAWSCAN_BULK_DEPTH;
+
+    if ((bp = calloc(1, sizeof(*bp))) == NULL)
+        return NULL;
+    bp->returned = -1;
+    bp->paths = calloc(npaths ? npaths : 1, sizeof(*bp->paths));
+    bp->slots = calloc(depth, sizeof(*bp->slots));
+    bp->readyq = calloc(depth, sizeof(*bp->readyq));
+    if (bp->paths == NULL || bp->slots == NULL || bp->readyq == NULL)
+        goto fail;
+    memcpy(bp->paths, paths, npaths * sizeof(*paths));
+    bp->npaths = npaths;
+
+    // The buffer pool: one rawscan stream per file in flight.
+    for (bp->nslots = 0; bp->nslots < depth; bp->nslots++) {
+        struct rawscan_bulk_slot *slot = &bp->slots[bp->nslots];
+
+        if ((slot->rsp = rawscan_pool_get(-1, bufsz, delimiterbyte)) == NULL)
+            goto fail;
+        slot->fd = -1;
+    }
+
+#if RAWSCAN_WITH_IO_URING
+    // Room for an open, or a read plus a close, per slot.
+    bp->use_ring = rawscan_uring_setup(&bp->ring, 2 * depth) == 0;
+    if (bp->use_ring && !rawscan_uring_probe(&bp->ring)) {
+        rawscan_uring_teardown(&bp->ring);      // pre-5.6: no openat
+        bp->use_ring = false;
+    }
+    if (bp->use_ring) {
+        struct iovec *iov = calloc(depth, sizeof(*iov));
+
+        if (iov != NULL) {
+            for (i = 0; i < depth; i++) {
+                iov[i].iov_base = (void *)bp->slots[i].rsp->buf;
+                iov[i].iov_len = bp->slots[i].rsp->bufsz;
+            }
+            // Can fail, e.g. on RLIMIT_MEMLOCK; then use plain reads.
+            bp->ring.fixed_bufs = syscall(SYS_io_uring_register, bp->ring.fd,
+                                IORING_REGISTER_BUFFERS, iov, depth) == 0;
+            free(iov);
+        }
+    }
+#endif
+
+    return bp;
+
+  fail:
+    for (i = 0; i < bp->nslots; i++)
+        rawscan_pool_put(bp->slots[i].rsp);
+    free(bp->readyq);
+    free(bp->slots);
+    free(bp->paths);
+    free(bp);
+    return NULL;
+}
+
+/*
+ * rs_merge_open(), rs_merge_next(): k-way merge of sorted streams.
+ *
+ * Given nrsps rawscan streams, each over input already sorted by the
+ * same order, rs_merge_next() returns their lines, one per call, in
+ * that order over all the streams, as does "sort -m".
+ *
+ * The lines are not copied.  The head (next unreturned) line of each
+ * stream stays in that stream's buffer, where rs_getline() returned
+ * it, and rs_merge_next() returns pointers into that buffer.  The
+ * stream whose line was returned is only advanced, by rs_getline(),
+ * at the start of the following rs_merge_next() call, so a returned
+ * line is valid until then.  The only copies made are of long lines,
+ * that don't fit in one piece in their stream's buffer; the chunks of
+ * such a line are collected into a separate per-stream buffer.
+ *
+ * The streams compete in a tournament "loser tree": each internal
+ * node of a binary tree over the streams holds the loser of the
+ * match played there, and the overall winner is kept above the root.
+ * After a stream is advanced, its new head line replays just the
+ * matches on its path to the root, log2(nrsps) comparisons, and,
+ * unlike a binary heap, compares with only one other line per level.
+ *
+ * With a NULL cmp, lines are ordered byte-wise, as by memcmp(), a line
+ * ordering before any longer line that it is a prefix of, which is
+ * the order of "LC_ALL=C sort".  Otherwise cmp(arg, a, alen, b, blen)
+ * returns less than, equal to, or greater than zero, as line a (alen
+ * bytes) orders before, same as, or after line b.  Either way, the
+ * delimiterbyte ending a line is not part of what's compared.  Equal
+ * lines are returned in stream order (lower index in rsps[] first).
+ *
+ * rs_merge_next() returns rt_full_line, or rt_full_line_without_eol
+ * if that stream's last line had no delimiterbyte, with the line's
+ * begin and end, as rs_getline() would, then rt_eof once all streams
+ * are exhausted.  If a stream fails, rs_merge_next() returns rt_err
+ * with its errno once, and continues merging the other streams after
+ * that.  A stream in pause mode is resumed whenever it pauses.
+ * rs_merge_stream_index() gives the index in rsps[] of the stream
+ * that the last returned line came from.
+ *
+ * The streams remain the caller's, to rs_close() after rs_merge_close().
+ */
+
+#define RAWSCAN_MERGE_NONE ((size_t)-1)
+
+struct rawscan_merge_src {
+    RAWSCAN *rsp;
+    RAWSCAN_RESULT head;    // stream's next unreturned line
+    size_t keylen;          // head's length, less any ending delimiterbyte
+    bool done;              // stream exhausted (eof or error)
+    char *copy;             // long line, collected from its chunks
+    size_t copylen;
+    size_t copycap;
+};
+
+struct RAWSCAN_MERGE {
+    struct rawscan_merge_src *srcs;
+    size_t *tree;           // [0]: winner; [1 .. n-1]: losers
+    size_t n;
+    rs_line_cmp_fn cmp;
+    void *arg;
+    size_t pending;         // advance this stream on next call
+    size_t last;            // stream of last returned line
+    int errnum;             // undelivered stream read error
+    bool started;
+};
+
+static int rawscan_bytes_cmp(const char *a, size_t alen,
+                             const char *b, size_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+
+    if (c != 0)
+        return c;
+    return (alen > blen) - (alen < blen);
+}
+
+// Does stream i's head order strictly before stream j's head?
+
+static bool rawscan_merge_less(RAWSCAN_MERGE *mp, size_t i, size_t j)
+{
+    struct rawscan_merge_src *a = &mp->srcs[i], *b = &mp->srcs[j];
+    int c;
+
+    if (a->done || b->done)
+        return b->done && (!a->done || i < j);
+
+    if (mp->cmp == NULL)
+        c = rawscan_bytes_cmp(a->head.line.begin, a->keylen,
+                              b->head.line.begin, b->keylen);
+    else
+        c = mp->cmp(mp->arg, a->head.line.begin, a->keylen,
+                             b->head.line.begin, b->keylen);
+    return c < 0 || (c == 0 && i < j);
+}
+
+static void rawscan_merge_append(RAWSCAN_MERGE *mp,
+                                 struct rawscan_merge_src *s, RAWSCAN_RESULT rt)
+{
+    size_t len = rt.line.end - rt.line.begin + 1;
+
+    if (s->copylen + len > s->copycap) {
+        size_t cap = s->copycap ? s->copycap : 4096;
+        char *copy;
+
+        while (cap < s->copylen + len)
+            cap *= 2;
+        if ((copy = realloc(s->copy, cap)) == NULL) {
+            mp->errnum = ENOMEM;
+            s->copylen = 0;             // loses this line; keeps going
+            return;
+        }
+        s->copy = copy;
+        s->copycap = cap;
+    }
+    memcpy(s->copy + s->copylen, rt.line.begin, len);
+    s->copylen += len;
+}
+
+// Set stream s's head to its next line, or mark it done.
+
+static void rawscan_merge_pull(RAWSCAN_MERGE *mp, struct rawscan_merge_src *s)
+{
+    RAWSCAN_RESULT rt;
+
+    for (;;) {
+        rt = rs_getline(s->rsp);
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+            s->head = rt;
+            s->keylen = rt.line.end - rt.line.begin + (rt.type != rt_full_line);
+            return;
+        case rt_start_longline:
+            s->copylen = 0;
+            /* fall through */
+        case rt_within_longline:
+            rawscan_merge_append(mp, s, rt);
+            continue;
+        case rt_longline_ended:
+            if (s->copylen == 0)
+                continue;
+            s->head.line.begin = s->copy;
+            s->head.line.end = s->copy + s->copylen - 1;
+            if (*s->head.line.end == s->rsp->delimiterbyte) {
+                s->head.type = rt_full_line;
+                s->keylen = s->copylen - 1;
+            } else {
+                s->head.type = rt_full_line_without_eol;
+                s->keylen = s->copylen;
+            }
+            return;
+        case rt_paused:
+            rs_resume_from_pause(s->rsp);
+            continue;
+        case rt_err:
+            mp->errnum = rt.errnum;
+            /* fall through */
+        case rt_eof:
+            s->done = true;
+            return;
+        }
+    }
+}
+
+// Play the initial tournament below node; return its winner.
+
+static size_t rawscan_merge_build(RAWSCAN_MERGE *mp, size_t node)
+{
+    size_t a, b;
+
+    if (node >= mp->n)
+        return node - mp->n;            // leaf: stream index
+
+    a = rawscan_merge_build(mp, 2 * node);
+    b = rawscan_merge_build(mp, 2 * node + 1);
+    if (rawscan_merge_less(mp, b, a)) {
+        mp->tree[node] = a;
+        return b;
+    }
+    mp->tree[node] = b;
+    return a;
+}
+
+// Stream w has a new head: replay its matches up to the root.
+
+static void rawscan_merge_replay(RAWSCAN_MERGE *mp, size_t w)
+{
+    size_t node;
+
+    for (node = (w + mp->n) / 2; node > 0; node /= 2) {
+        if (rawscan_merge_less(mp, mp->tree[node], w)) {
+            size_t t = mp->tree[node];
+
+            mp->tree[node] = w;
+            w = t;
+        }
+    }
+    mp->tree[0] = w;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_merge_next(RAWSCAN_MERGE *mp)
+{
+    RAWSCAN_RESULT rt;
+    struct rawscan_merge_src *s;
+    size_t i;
+
+    if (!mp->started) {
+        for (i = 0; i < mp->n; i++)
+            rawscan_merge_pull(mp, &mp->srcs[i]);
+        mp->tree[0] = mp->n > 1 ? rawscan_merge_build(mp, 1) : 0;
+        mp->started = true;
+    } else if (mp->pending != RAWSCAN_MERGE_NONE) {
+        rawscan_merge_pull(mp, &mp->srcs[mp->pending]);
+        rawscan_merge_replay(mp, mp->pending);
+        mp->pending = RAWSCAN_MERGE_NONE;
+    }
+
+    if (mp->errnum != 0) {
+        rt.type = rt_err;
+        rt.errnum = mp->errnum;
+        mp->errnum = 0;
+        return rt;
+    }
+
+    if (mp->n == 0 || (s = &mp->srcs[mp->tree[0]])->done) {
+        rt.type = rt_eof;
+        return rt;
+    }
+
+    mp->last = mp->pending = mp->tree[0];
+    return s->head;
+}
+
+__unused__ func_static size_t rs_merge_stream_index(RAWSCAN_MERGE *mp)
+{
+    return mp->last;
+}
+
+__unused__ func_static void rs_merge_close(RAWSCAN_MERGE *mp)
+{
+    size_t i;
+
+    for (i = 0; i < mp->n; i++)
+        free(mp->srcs[i].copy);
+    free(mp->srcs);
+    free(mp->tree);
+    free(mp);
+}
+
+__unused__ func_static RAWSCAN_MERGE *rs_merge_open (
+  RAWSCAN *const rsps[],     // sorted input streams
+  size_t nrsps,              // how many streams
+  rs_line_cmp_fn cmp,        // line order, or NULL for byte-wise order
+  void *arg)                 // passed unchanged to each cmp() call
+{
+    RAWSCAN_MERGE *mp;
+    size_t i;
+
+    if ((mp = calloc(1, sizeof(*mp))) == NULL)
+        return NULL;
+    mp->srcs = calloc(nrsps ? nrsps : 1, sizeof(*mp->srcs));
+    mp->tree = calloc(nrsps ? nrsps : 1, sizeof(*mp->tree));
+    if (mp->srcs == NULL || mp->tree == NULL) {
+        free(mp->srcs);
+        free(mp->tree);
+        free(mp);
+        return NULL;
+    }
+    for (i = 0; i < nrsps; i++)
+        mp->srcs[i].rsp = rsps[i];
+    mp->n = nrsps;
+    mp->cmp = cmp;
+    mp->arg = arg;
+    mp->pending = RAWSCAN_MERGE_NONE;
+    mp->last = RAWSCAN_MERGE_NONE;
+    return mp;
+}
+
+/*
+ * rs_sort(): external, parallel sort of the lines of a file.
+ *
+ * Sorts the lines read from infd, byte-wise (as "LC_ALL=C sort"),
+ * writing them to outfd, in at most about memsz bytes of memory for
+ * the lines being sorted, plus a rawscan buffer of bufsz bytes for
+ * reading the input and, if the input doesn't fit in memsz, one per
+ * temporary run file being merged.
+ *
+ * The input is read with rawscan, and each line (with its ending
+ * delimiterbyte, supplying one if the last line lacks it) is copied
+ * into an arena that fills memsz from the bottom up, while an array
+ * of (offset, length) spans, one per line, grows down from the top.
+ * Once no room is left for another line and its span, plus a second
+ * span per line for sorting, the spans are sorted and that "run" of
+ * lines is written to an (unlinked) temporary file in tmpdir, and
+ * the arena starts over empty.
+ *
+ * Spans are sorted on nthreads threads (<= 0: one per online cpu),
+ * each sorting a slice of the spans with an MSD (most significant
+ * digit first) radix sort on the line bytes, then the sorted slices
+ * are merged pairwise, also in parallel.  The radix sort, working
+ * one byte position at a time, steps over common prefixes (such as
+ * the timestamps leading each line of a log) without distributing
+ * the spans, and leaves small buckets, and any recursing too deep,
+ * to comparison sorts.
+ *
+ * If all the input fit in one run, it is written straight to outfd.
+ * Otherwise the runs are merged, using rs_merge_*(), up to
+ * RAWSCAN_SORT_MAXMERGE at a time (merging groups into further
+ * temporary files first, if there are more runs than that).
+ *
+ * The rawscan streams for the input and the merges are from the
+ * stream pool.
+ *
+ * Returns count of lines sorted, or -1, with errno set, if a read,
+ * write or temporary file failed, or a single line didn't fit in
+ * memsz (0: RAWSCAN_SORT_MEMSZ).  tmpdir NULL: use $TMPDIR, or /tmp.
+ */
+
+#ifndef RAWSCAN_SORT_MEMSZ
+#define RAWSCAN_SORT_MEMSZ (256*1024*1024)
+#endif
+
+#ifndef RAWSCAN_SORT_MAXMERGE
+#define RAWSCAN_SORT_MAXMERGE 64
+#endif
+
+#define RAWSCAN_OUTBUF (64*1024)
+#define RAWSCAN_SORT_INSERTION 32       // insertion sort buckets this small
+#define RAWSCAN_SORT_MAXLEVEL 64        // deeper radix recursion: merge sort
+
+struct rawscan_span {
+    size_t off;             // offset of line in arena
+    size_t len;             // length of line, less its delimiterbyte
+};
+
+struct rawscan_out {
+    int fd;
+    char *buf;
+    size_t len;
+    int errnum;             // first write error
+};
+
+static void rawscan_out_flush(struct rawscan_out *o)
+{
+    const char *p = o->buf;
+    size_t left = o->len;
+
+    while (left > 0 && o->errnum == 0) {
+        ssize_t cnt = write(o->fd, p, left);
+
+        if (cnt < 0 && errno != EINTR)
+            o->errnum = errno;
+        if (cnt > 0) {
+            p += cnt;
+            left -= cnt;
+        }
+    }
+    o->len = 0;
+}
+
+static void rawscan_out_emit(struct rawscan_out *o,
+                              const char *line, size_t len)
+{
+    while (len > 0) {
+        size_t n = RAWSCAN_OUTBUF - o->len;
+
+        if (n > len)
+            n = len;
+        memcpy(o->buf + o->len, line, n);
+        o->len += n;
+        line += n;
+        len -= n;
+        if (o->len == RAWSCAN_OUTBUF)
+            rawscan_out_flush(o);
+    }
+}
+
+static int rawscan_span_cmp(const char *arena, const struct rawscan_span *a,
+                            const struct rawscan_span *b, size_t depth)
+{
+    return rawscan_bytes_cmp(arena + a->off + depth, a->len - depth,
+                             arena + b->off + depth, b->len - depth);
+}
+
+// Spans in s all agree in their first depth bytes; sort them.
+
+static void rawscan_sort_insertion(const char *arena, struct rawscan_span *s,
+                                   size_t n, size_t depth)
+{
+    size_t i, j;
+
+    for (i = 1; i < n; i++) {
+        struct rawscan_span t = s[i];
+
+        for (j = i; j > 0 && rawscan_span_cmp(arena, &t, &s[j-1], depth) < 0; j--)
+            s[j] = s[j-1];
+        s[j] = t;
+    }
+}
+
+// Merge sorted a[0 .. na-1] and b[0 .. nb-1] into out.
+
+static void rawscan_sort_merge(const char *arena,
+        const struct rawscan_span *a, size_t na,
+        const struct rawscan_span *b, size_t nb,
+        struct rawscan_span *out, size_t depth)
+{
+    while (na > 0 && nb > 0) {
+        if (rawscan_span_cmp(arena, b, a, depth) < 0)
+            *out++ = *b++, nb--;
+        else
+            *out++ = *a++, na--;
+    }
+    memcpy(out, a, na * sizeof(*a));
+    memcpy(out + na, b, nb * sizeof(*b));
+}
+
+static void rawscan_sort_mergesort(const char *arena, struct rawscan_span *s,
+                        struct rawscan_span *aux, size_t n, size_t depth)
+{
+    size_t h = n / 2;
+
+    if (n < RAWSCAN_SORT_INSERTION) {
+        rawscan_sort_insertion(arena, s, n, depth);
+        return;
+    }
+    rawscan_sort_mergesort(arena, s, aux, h, depth);
+    rawscan_sort_mergesort(arena, s + h, aux + h, n - h, depth);
+    rawscan_sort_merge(arena, s, h, s + h, n - h, aux, depth);
+    memcpy(s, aux, n * sizeof(*s));
+}
+
+// Byte of span at depth, plus one; 0 if span ends before depth.
+
+#define rawscan_span_byte(arena, sp, depth) \
+    ((depth) < (sp)->len ? (unsigned char)(arena)[(sp)->off + (depth)] + 1 : 0)
+
+static void rawscan_sort_msd(const char *arena, struct rawscan_span *s,
+            struct rawscan_span *aux, size_t n, size_t depth, int level)
+{
+    size_t end[257];
+    size_t i, k;
+
+    if (level >= RAWSCAN_SORT_MAXLEVEL) {
+        rawscan_sort_mergesort(arena, s, aux, n, depth);
+        return;
+    }
+
+    while (n >= RAWSCAN_SORT_INSERTION) {
+        memset(end, 0, sizeof(end));
+        for (i = 0; i < n; i++)
+            end[rawscan_span_byte(arena, &s[i], depth)]++;
+
+        // All in one bucket: step over this common byte.
+        k = rawscan_span_byte(arena, &s[0], depth);
+        if (end[k] == n) {
+            if (k == 0)
+                return;                 // all equal
+            depth++;
+            continue;
+        }
+
+        for (k = 1; k < 257; k++)
+            end[k] += end[k-1];
+        for (i = n; i-- > 0; )
+            aux[--end[rawscan_span_byte(arena, &s[i], depth)]] = s[i];
+        memcpy(s, aux, n * sizeof(*s));
+
+        // end[k] is now the start of bucket k; bucket 0 is all equal.
+        for (k = 1; k < 257; k++) {
+            size_t lo = end[k], hi = k < 256 ? end[k+1] : n;
+
+            if (hi - lo > 1)
+                rawscan_sort_msd(arena, s + lo, aux + lo, hi - lo,
+                                 depth + 1, level + 1);
+        }
+        return;
+    }
+    rawscan_sort_insertion(arena, s, n, depth);
+}
+
+struct rawscan_sort_task {
+    const char *arena;
+    struct rawscan_span *s, *aux;       // sort, or merge from s into aux
+    size_t n, h;                        // h > 0: merge s[0,h) and s[h,n)
+};
+
+static void *rawscan_sort_task(void *arg)
+{
+    struct rawscan_sort_task *t = arg;
+
+    if (t->h == 0)
+        rawscan_sort_msd(t->arena, t->s, t->aux, t->n, 0, 0);
+    else
+        rawscan_sort_merge(t->arena, t->s, t->h, t->s + t->h, t->n - t->h,
+                           t->aux, 0);
+    return NULL;
+}
+
+static void rawscan_sort_run_tasks(struct rawscan_sort_task *tasks,
+                                   pthread_t *threads, int ntasks)
+{
+    int t, nstarted;
+
+    for (nstarted = 1; nstarted < ntasks; nstarted++)
+        if (pthread_create(&threads[nstarted], NULL,
+                            rawscan_sort_task, &tasks[nstarted]) != 0)
+            break;
+    rawscan_sort_task(&tasks[0]);
+    for (t = nstarted; t < ntasks; t++)         // couldn't start: do here
+        rawscan_sort_task(&tasks[t]);
+    for (t = 1; t < nstarted; t++)
+        pthread_join(threads[t], NULL);
+}
+
+// Sort s[0 .. n-1], using aux; return whichever of the two holds the result.
+
+static struct rawscan_span *rawscan_sort_spans(const char *arena,
+        struct rawscan_span *s, struct rawscan_span *aux, size_t n, int nthreads)
+{
+    struct rawscan_sort_task tasks[nthreads];
+    pthread_t threads[nthreads];
+    size_t lo[nthreads + 1];
+    int t, nslices;
+
+    if ((size_t)nthreads > n / 1024 + 1)
+        nthreads = n / 1024 + 1;        // not worth a thread per few lines
+
+    for (t = 0; t <= nthreads; t++)
+        lo[t] = n * t / nthreads;
+    for (t = 0; t < nthreads; t++) {
+        tasks[t].arena = arena;
+        tasks[t].s = s + lo[t];
+        tasks[t].aux = aux + lo[t];
+        tasks[t].n = lo[t+1] - lo[t];
+        tasks[t].h = 0;
+    }
+    rawscan_sort_run_tasks(tasks, threads, nthreads);
+
+    // Merge slices pairwise, from s into aux, then swap, till one is left.
+    for (nslices = nthreads; nslices > 1; nslices = (nslices + 1) / 2) {
+        struct rawscan_span *tmp;
+        int ntasks = 0;
+
+        for (t = 0; t < nslices; t += 2) {
+            size_t b = lo[t], m = lo[t+1], e = lo[t+2 <= nslices ? t+2 : t+1];
+
+            tasks[ntasks].arena = arena;
+            tasks[ntasks].s = s + b;
+            tasks[ntasks].aux = aux + b;
+            tasks[ntasks].n = e - b;
+            tasks[ntasks].h = t + 1 < nslices ? m - b : e - b;
+            ntasks++;
+        }
+        rawscan_sort_run_tasks(tasks, threads, ntasks);
+        for (t = 0; t < nslices; t += 2)
+            lo[t / 2] = lo[t];
+        lo[(nslices + 1) / 2] = n;
+        tmp = s, s = aux, aux = tmp;
+    }
+    return s;
+}
+
+// Create, open and unlink a temporary file.  (mkstemp() is hidden
+// by our _POSIX_C_SOURCE, so we make our own unique names.)
+
+static int rawscan_tmpfile(const char *tmpdir)
+{
+    static unsigned serial;
+    char path[PATH_MAX];
+    int fd;
+
+    do {
+        if (snprintf(path, sizeof(path), "%s/rawscan.%ld.%u", tmpdir,
+                (long)getpid(), __sync_fetch_and_add(&serial, 1))
+                                                    >= (int)sizeof(path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } while (fd < 0 && errno == EEXIST);
+    if (fd >= 0)
+        unlink(path);
+    return fd;
+}
+
+struct rawscan_sort_runs {
+    int *fds;               // unlinked temporary files, each a sorted run
+    size_t n;
+    size_t cap;
+};
+
+// Write sorted[0 .. nspans-1] to a new run file; return 0 or errno.
+
+static int rawscan_sort_spill(struct rawscan_sort_runs *runs,
+        const char *tmpdir, const char *arena, const struct rawscan_span *sorted,
+        size_t nspans, struct rawscan_out *o)
+{
+    size_t i;
+
+    if (runs->n == runs->cap) {
+        int *fds = realloc(runs->fds, (runs->cap + 16) * sizeof(*fds));
+
+        if (fds == NULL)
+            return ENOMEM;
+        runs->fds = fds;
+        runs->cap += 16;
+    }
+    if ((o->fd = rawscan_tmpfile(tmpdir)) < 0)
+        return errno;
+    runs->fds[runs->n++] = o->fd;
+    for (i = 0; i < nspans; i++)
+        rawscan_out_emit(o, arena + sorted[i].off, sorted[i].len + 1);
+    rawscan_out_flush(o);
+    return o->errnum;
+}
+
+// Merge runs[0 .. nruns-1] (nruns <= RAWSCAN_SORT_MAXMERGE) into o.
+
+static int rawscan_sort_merge_runs(RAWSCAN **rsps, const int *runs,
+                                   size_t nruns, struct rawscan_out *o)
+{
+    RAWSCAN_MERGE *mp;
+    RAWSCAN_RESULT rt;
+    size_t i;
+    int errnum = 0;
+
+    for (i = 0; i < nruns; i++) {
+        lseek(runs[i], 0, SEEK_SET);
+        rs_reopen(rsps[i], runs[i]);
+    }
+    if ((mp = rs_merge_open(rsps, nruns, NULL, NULL)) == NULL)
+        return ENOMEM;
+    while ((rt = rs_merge_next(mp)).type != rt_eof) {
+        if (rt.type == rt_err) {
+            errnum = rt.errnum;
+            break;
+        }
+        rawscan_out_emit(o, rt.line.begin, rt.line.end - rt.line.begin + 1);
+    }
+    rs_merge_close(mp);
+    rawscan_out_flush(o);
+    return errnum != 0 ? errnum : o->errnum;
+}
+
+__unused__ func_static long rs_sort (
+  int infd,            // read lines to sort from this file descriptor
+  int outfd,           // write sorted lines here
+  size_t bufsz,        // rawscan input buffer size, per stream
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  size_t memsz,        // memory for lines being sorted (0: default)
+  int nthreads,        // number of sorting threads (<= 0: ncpus)
+  const char *tmpdir)  // directory for temporary files (NULL: $TMPDIR, /tmp)
+{
+    const size_t spansz = 2 * sizeof(struct rawscan_span);   // span plus aux
+    struct rawscan_out o;
+    struct rawscan_sort_runs runs = { NULL, 0, 0 };
+    RAWSCAN *rsp, *mrsps[RAWSCAN_SORT_MAXMERGE];
+    RAWSCAN_RESULT rt;
+    struct rawscan_span *top, *spans, *sorted;
+    char *arena = NULL;
+    size_t used = 0, nspans = 0, linestart = 0, nmrsps = 0, i;
+    long nlines = 0;
+    int errnum = 0;
+
+    if (memsz == 0)
+        memsz = RAWSCAN_SORT_MEMSZ;
+    memsz -= memsz % sizeof(struct rawscan_span);
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+    if (tmpdir == NULL && (tmpdir = getenv("TMPDIR")) == NULL)
+        tmpdir = "/tmp";
+
+    memset(&o, 0, sizeof(o));
+    if ((rsp = rawscan_pool_get(infd, bufsz, delimiterbyte)) == NULL)
+        return -1;
+    if ((arena = malloc(memsz)) == NULL
+                    || (o.buf = malloc(RAWSCAN_OUTBUF)) == NULL) {
+        errnum = ENOMEM;
+        goto done;
+    }
+    top = (struct rawscan_span *)(arena + memsz);
+
+    for (;;) {
+        const char *begin = NULL;
+        size_t len = 0;
+
+        rt = rs_getline(rsp);
+        if (rt.type == rt_paused) {
+            rs_resume_from_pause(rsp);
+            continue;
+        }
+        if (rt.type == rt_eof)
+            break;
+        if (rt.type == rt_err) {
+            errnum = rt.errnum;
+            goto done;
+        }
+        if (rt.type != rt_longline_ended) {
+            begin = rt.line.begin;
+            len = rt.line.end - rt.line.begin + 1;
+        }
+
+        // No room for this line (or chunk, plus a delimiterbyte) and
+        // its spans: sort and spill the lines before it.
+        if (used + len + 1 + (nspans + 1) * spansz > memsz) {
+            if (linestart == 0) {
+                errnum = ENOMEM;                // line longer than memsz
+                goto done;
+            }
+            spans = top - nspans;
+            sorted = rawscan_sort_spans(arena, spans, spans - nspans,
+                                        nspans, nthreads);
+            if ((errnum = rawscan_sort_spill(&runs, tmpdir, arena,
+                                             sorted, nspans, &o)) != 0)
+                goto done;
+            memmove(arena, arena + linestart, used - linestart);
+            used -= linestart;
+            linestart = 0;
+            nspans = 0;
+        }
+
+        if (len > 0) {
+            memcpy(arena + used, begin, len);
+            used += len;
+        }
+        if (rt.type == rt_start_longline || rt.type == rt_within_longline)
+            continue;                           // more of this line to come
+
+        if (arena[used - 1] != delimiterbyte)   // supply missing final eol
+            arena[used++] = delimiterbyte;
+        nspans++;
+        top[-(ssize_t)nspans].off = linestart;
+        top[-(ssize_t)nspans].len = used - linestart - 1;
+        linestart = used;
+        nlines++;
+    }
+
+    spans = top - nspans;
+    sorted = rawscan_sort_spans(arena, spans, spans - nspans, nspans, nthreads);
+    if (runs.n == 0) {                          // it all fit: done
+        o.fd = outfd;
+        for (i = 0; i < nspans; i++)
+            rawscan_out_emit(&o, arena + sorted[i].off, sorted[i].len + 1);
+        rawscan_out_flush(&o);
+        errnum = o.errnum;
+        goto done;
+    }
+    if (nspans > 0 && (errnum = rawscan_sort_spill(&runs, tmpdir, arena,
+                                                   sorted, nspans, &o)) != 0)
+        goto done;
+    free(arena);
+    arena = NULL;
+
+    // Merge streams are allocated once, and reused (rs_reopen) per merge.
+    for (nmrsps = 0; nmrsps < runs.n && nmrsps < RAWSCAN_SORT_MAXMERGE; nmrsps++)
+        if ((mrsps[nmrsps] = rawscan_pool_get(-1, bufsz,
+                                              delimiterbyte)) == NULL) {
+            errnum = errno;
+            goto done;
+        }
+
+    // Too many runs to merge at once: merge the first few into another.
+    while (runs.n > RAWSCAN_SORT_MAXMERGE) {
+        if ((o.fd = rawscan_tmpfile(tmpdir)) < 0) {
+            errnum = errno;
+            goto done;
+        }
+        errnum = rawscan_sort_merge_runs(mrsps, runs.fds,
+                                         RAWSCAN_SORT_MAXMERGE, &o);
+        for (i = 0; i < RAWSCAN_SORT_MAXMERGE; i++)
+            close(runs.fds[i]);
+        runs.n -= RAWSCAN_SORT_MAXMERGE;
+        memmove(runs.fds, runs.fds + RAWSCAN_SORT_MAXMERGE,
+                runs.n * sizeof(*runs.fds));
+        runs.fds[runs.n++] = o.fd;              // room: just freed some
+        if (errnum != 0)
+            goto done;
+    }
+    o.fd = outfd;
+    errnum = rawscan_sort_merge_runs(mrsps, runs.fds, runs.n, &o);
+
+  done:
+    for (i = 0; i < nmrsps; i++)
+        rawscan_pool_put(mrsps[i]);
+    for (i = 0; i < runs.n; i++)
+        close(runs.fds[i]);
+    free(runs.fds);
+    free(o.buf);
+    free(arena);
+    rawscan_pool_put(rsp);
+    if (errnum != 0) {
+        errno = errnum;
+        return -1;
+    }
+    return nlines;
+}
+
+/*
+ * rs_dedup(): remove duplicate lines, without sorting.
+ *
+ * In rs_dedup_adjacent mode, as uniq(1) does, each line that is the
+ * same as the line just before it is dropped.  rs_dedup_adjacent
+ * runs the input stream in pause mode, so that the previous line can
+ * be compared where rs_getline() returned it, in the stream's buffer,
+ * being copied aside only when the stream pauses to refill.
+ *
+ * In rs_dedup_global mode, the first occurrence of each distinct
+ * line is output, and all its later duplicates dropped, as with
+ * "sort -u", but in order of first occurrence, and without sorting.
+ * Each line is hashed, with rawscan_hash64(), and looked up in an
+ * open addressing hash table of 8 byte entries, each holding the
+ * offset of a distinct line in a bump arena and 24 more bits of its
+ * hash, to skip most mismatches without touching the arena.  Only
+ * first seen lines are copied, once, into the arena.
+ *
+ * The arena and table are kept within memsz bytes (0: use
+ * RAWSCAN_DEDUP_MEMSZ).  Once they're full, a line that isn't found
+ * in the table is spilled to one of RAWSCAN_DEDUP_FANOUT temporary
+ * files in tmpdir (NULL: $TMPDIR or /tmp), picked by a few more of
+ * the bits of its hash.  Once the input is done, each spill file is
+ * deduplicated in turn, in the same way, with an empty table, using
+ * a differently seeded hash, spilling further if need be.  Lines
+ * that are spilled are thus output after all those that aren't, in
+ * order of first occurrence within each spill file.
+ *
+ * In either mode, a line lacking its final delimiterbyte is the same
+ * as that line with it, and is output with it.  The input and spill
+ * streams are from the stream pool.
+ *
+ * Returns count of lines output, or -1, with errno set, if a read,
+ * write or temporary file failed, or a line didn't fit in memsz.
+ */
+
+#ifndef RAWSCAN_DEDUP_MEMSZ
+#define RAWSCAN_DEDUP_MEMSZ (256*1024*1024)
+#endif
+
+#define RAWSCAN_DEDUP_FANOUT 16         // spill files per level
+#define RAWSCAN_DEDUP_MAXLEVEL 16       // how often a spill can respill
+#define RAWSCAN_DEDUP_OFFBITS 40        // table entry: 24 bits hash, 40 offset
+#define RAWSCAN_DEDUP_OFFMASK ((UINT64_C(1) << RAWSCAN_DEDUP_OFFBITS) - 1)
+
+struct rawscan_dedup_rec {      // arena record header; line follows
+    uint64_t hash;
+    size_t len;
+};
+
+typedef struct rawscan_dedup {
+    char *arena;
+    size_t used;                // arena bytes in use
+    uint64_t *table;
+    size_t mask;                // table size, less one
+    size_t count;               // table entries in use
+    size_t memsz;
+    bool full;                  // no room for more lines: spill
+    char delimiterbyte;
+    const char *tmpdir;
+    RAWSCAN *spillrsp;          // reads spill files, one at a time
+    struct rawscan_out out;
+    long nout;
+    int errnum;
+} rawscan_dedup;
+
+struct rawscan_dedup_spill {    // one level of spill files
+    struct rawscan_out files[RAWSCAN_DEDUP_FANOUT];
+};
+
+static size_t rawscan_dedup_recsz(size_t len)
+{
+    return sizeof(struct rawscan_dedup_rec) + ((len + 7) & ~(size_t)7);
+}
+
+// Double the table, if there's room; else we're full.
+
+static bool rawscan_dedup_grow(rawscan_dedup *d)
+{
+    size_t newmask = 2 * d->mask + 1, i, j;
+    uint64_t *newtable;
+
+    if (d->used + (newmask + 1 + d->mask + 1) * sizeof(uint64_t) > d->memsz
+                    || (newtable = calloc(newmask + 1, sizeof(uint64_t))) == NULL)
+        return false;
+    for (i = 0; i <= d->mask; i++) {
+        uint64_t e = d->table[i];
+        struct rawscan_dedup_rec *rec;
+
+        if (e == 0)
+            continue;
+        rec = (struct rawscan_dedup_rec *)
+                    (d->arena + (e & RAWSCAN_DEDUP_OFFMASK) - 1);
+        for (j = rec->hash & newmask; newtable[j] != 0; j = (j + 1) & newmask)
+            ;
+        newtable[j] = e;
+    }
+    free(d->table);
+    d->table = newtable;
+    d->mask = newmask;
+    return true;
+}
+
+static void rawscan_dedup_emit(struct rawscan_out *o, const char *p,
+                               size_t len, char delimiterbyte)
+{
+    rawscan_out_emit(o, p, len);
+    rawscan_out_emit(o, &delimiterbyte, 1);
+}
+
+// Line p (len bytes, less delimiterbyte): output it if first seen.
+
+static void rawscan_dedup_line(rawscan_dedup *d, const char *p, size_t len,
+                               int level, struct rawscan_dedup_spill *spill)
+{
+    uint64_t h = rawscan_hash64(p, len, level);
+    uint64_t tag = h >> RAWSCAN_DEDUP_OFFBITS << RAWSCAN_DEDUP_OFFBITS;
+    struct rawscan_out *so;
+    size_t i, recsz;
+
+    // Keep the load at most one half, growing the table (before
+    // probing it) while there's room.
+    if (!d->full && (d->count + 1) * 2 > d->mask + 1 && !rawscan_dedup_grow(d))
+        d->full = true;
+
+    for (i = h & d->mask; d->table[i] != 0; i = (i + 1) & d->mask) {
+        uint64_t e = d->table[i];
+        const struct rawscan_dedup_rec *rec;
+
+        if ((e & ~RAWSCAN_DEDUP_OFFMASK) != tag)
+            continue;
+        rec = (const struct rawscan_dedup_rec *)
+                    (d->arena + (e & RAWSCAN_DEDUP_OFFMASK) - 1);
+        if (rec->hash == h && rec->len == len
+                    && memcmp(rec + 1, p, len) == 0)
+            return;                             // duplicate
+    }
+
+    recsz = rawscan_dedup_recsz(len);
+    if (!d->full && d->used + recsz + (d->mask + 1) * sizeof(uint64_t) > d->memsz)
+        d->full = true;
+
+    if (!d->full) {                             // first seen: keep and output
+        struct rawscan_dedup_rec *rec =
+                    (struct rawscan_dedup_rec *)(d->arena + d->used);
+
+        rec->hash = h;
+        rec->len = len;
+        memcpy(rec + 1, p, len);
+        d->table[i] = tag | (d->used + 1);
+        d->used += recsz;
+        d->count++;
+        rawscan_dedup_emit(&d->out, p, len, d->delimiterbyte);
+        d->nout++;
+        return;
+    }
+
+    // Full: spill it, picking a file by hash bits used for neither
+    // the table index nor the tag.
+    if (d->count == 0 || level + 1 >= RAWSCAN_DEDUP_MAXLEVEL) {
+        d->errnum = ENOMEM;                     // can't ever fit
+        return;
+    }
+    so = &spill->files[(h >> (RAWSCAN_DEDUP_OFFBITS - 4)) % RAWSCAN_DEDUP_FANOUT];
+    if (so->buf == NULL) {
+        if ((so->buf = malloc(RAWSCAN_OUTBUF)) == NULL) {
+            d->errnum = ENOMEM;
+            return;
+        }
+        if ((so->fd = rawscan_tmpfile(d->tmpdir)) < 0) {
+            d->errnum = errno;
+            return;
+        }
+    }
+    rawscan_dedup_emit(so, p, len, d->delimiterbyte);
+    if (so->errnum != 0)
+        d->errnum = so->errnum;
+}
+
+// Deduplicate the lines of rsp, against an empty table, at this level.
+
+static void rawscan_dedup_run(rawscan_dedup *d, RAWSCAN *rsp, int level)
+{
+    struct rawscan_dedup_spill spill;
+    RAWSCAN_RESULT rt;
+    char *longline = NULL;
+    size_t longlen = 0, longcap = 0;
+    int k;
+
+    memset(&spill, 0, sizeof(spill));
+    for (k = 0; k < RAWSCAN_DEDUP_FANOUT; k++)
+        spill.files[k].fd = -1;
+    memset(d->table, 0, (d->mask + 1) * sizeof(uint64_t));
+    d->used = d->count = 0;
+    d->full = false;
+
+    while (d->errnum == 0 && d->out.errnum == 0) {
+        rt = rs_getline(rsp);
+        switch (rt.type) {
+        case rt_full_line:
+            rawscan_dedup_line(d, rt.line.begin, rt.line.end - rt.line.begin,
+                               level, &spill);
+            continue;
+        case rt_full_line_without_eol:
+            rawscan_dedup_line(d, rt.line.begin,
+                               rt.line.end - rt.line.begin + 1, level, &spill);
+            continue;
+        case rt_start_longline:
+            longlen = 0;
+            /* fall through */
+        case rt_within_longline: {
+            size_t len = rt.line.end - rt.line.begin + 1;
+
+            if (longlen + len > longcap) {
+                char *newlong;
+
+                longcap = 2 * (longlen + len);
+                if ((newlong = realloc(longline, longcap)) == NULL) {
+                    d->errnum = ENOMEM;
+                    continue;
+                }
+                longline = newlong;
+            }
+            memcpy(longline + longlen, rt.line.begin, len);
+            longlen += len;
+            continue;
+        }
+        case rt_longline_ended:
+            if (longlen > 0 && longline[longlen - 1] == d->delimiterbyte)
+                longlen--;
+            rawscan_dedup_line(d, longline, longlen, level, &spill);
+            continue;
+        case rt_paused:
+            rs_resume_from_pause(rsp);
+            continue;
+        case rt_err:
+            d->errnum = rt.errnum;
+            continue;
+        case rt_eof:
+            break;
+        }
+        break;
+    }
+    free(longline);
+
+    for (k = 0; k < RAWSCAN_DEDUP_FANOUT; k++) {
+        struct rawscan_out *so = &spill.files[k];
+
+        if (so->buf == NULL)
+            continue;
+        if (so->fd >= 0) {
+            rawscan_out_flush(so);
+            if (d->errnum == 0 && so->errnum != 0)
+                d->errnum = so->errnum;
+            if (d->errnum == 0 && d->out.errnum == 0) {
+                lseek(so->fd, 0, SEEK_SET);
+                rs_reopen(d->spillrsp, so->fd);
+                rawscan_dedup_run(d, d->spillrsp, level + 1);
+            }
+            close(so->fd);
+        }
+        free(so->buf);
+    }
+}
+
+static long rawscan_dedup_global(int infd, int outfd, size_t bufsz,
+        char delimiterbyte, size_t memsz, const char *tmpdir)
+{
+    rawscan_dedup d;
+    RAWSCAN *rsp;
+
+    memset(&d, 0, sizeof(d));
+    d.memsz = memsz ? memsz : RAWSCAN_DEDUP_MEMSZ;
+    d.delimiterbyte = delimiterbyte;
+    if (tmpdir == NULL && (tmpdir = getenv("TMPDIR")) == NULL)
+        tmpdir = "/tmp";
+    d.tmpdir = tmpdir;
+    d.out.fd = outfd;
+    d.mask = 1023;
+
+    if ((rsp = rawscan_pool_get(infd, bufsz, delimiterbyte)) == NULL)
+        return -1;
+    if ((d.arena = malloc(d.memsz)) == NULL
+                    || (d.table = malloc((d.mask + 1) * sizeof(uint64_t))) == NULL
+                    || (d.out.buf = malloc(RAWSCAN_OUTBUF)) == NULL) {
+        d.errnum = ENOMEM;
+        goto done;
+    }
+    // One stream for reading spill files, reused for each (rs_reopen).
+    if ((d.spillrsp = rawscan_pool_get(-1, bufsz, delimiterbyte)) == NULL) {
+        d.errnum = errno;
+        goto done;
+    }
+
+    rawscan_dedup_run(&d, rsp, 0);
+    rawscan_out_flush(&d.out);
+
+  done:
+    if (d.spillrsp != NULL)
+        rawscan_pool_put(d.spillrsp);
+    rawscan_pool_put(rsp);
+    free(d.out.buf);
+    free(d.table);
+    free(d.arena);
+    if (d.errnum == 0)
+        d.errnum = d.out.errnum;
+    if (d.errnum != 0) {
+        errno = d.errnum;
+        return -1;
+    }
+    return d.nout;
+}
+
+static long rawscan_dedup_adjacent(int infd, int outfd, size_t bufsz,
+                                   char delimiterbyte)
+{
+    struct rawscan_out o;
+    RAWSCAN *rsp;
+    RAWSCAN_RESULT rt;
+    const char *prev = NULL;    // previous line, in rsp's buffer or in copy
+    size_t prevlen = 0;
+    char *copy = NULL, *longline = NULL;
+    size_t copycap = 0, longlen = 0, longcap = 0;
+    long nout = 0;
+    int errnum = 0;
+
+    memset(&o, 0, sizeof(o));
+    o.fd = outfd;
+    if ((rsp = rawscan_pool_get(infd, bufsz, delimiterbyte)) == NULL)
+        return -1;
+    if ((o.buf = malloc(RAWSCAN_OUTBUF)) == NULL) {
+        errnum = ENOMEM;
+        goto done;
+    }
+    rs_enable_pause(rsp);
+
+    while (errnum == 0 && o.errnum == 0) {
+        const char *p;
+        size_t len;
+
+        rt = rs_getline(rsp);
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+            p = rt.line.begin;
+            len = rt.line.end - rt.line.begin + (rt.type != rt_full_line);
+            break;
+        case rt_start_longline:
+            longlen = 0;
+            /* fall through */
+        case rt_within_longline:
+            len = rt.line.end - rt.line.begin + 1;
+            if (longlen + len > longcap) {
+                char *newlong;
+
+                longcap = 2 * (longlen + len);
+                if ((newlong = realloc(longline, longcap)) == NULL) {
+                    errnum = ENOMEM;
+                    continue;
+                }
+                longline = newlong;
+            }
+            memcpy(longline + longlen, rt.line.begin, len);
+            longlen += len;
+            continue;
+        case rt_longline_ended:
+            p = longline;
+            len = longlen;
+            if (len > 0 && longline[len - 1] == delimiterbyte)
+                len--;
+            break;
+        case rt_paused:
+            // The buffer is about to move: copy aside the previous line.
+            if (prev != NULL && prev != copy) {
+                if (prevlen > copycap) {
+                    char *newcopy = realloc(copy, prevlen);
+
+                    if (newcopy == NULL) {
+                        errnum = ENOMEM;
+                        continue;
+                    }
+                    copy = newcopy;
+                    copycap = prevlen;
+                }
+                memcpy(copy, prev, prevlen);
+                prev = copy;
+            }
+            rs_resume_from_pause(rsp);
+            continue;
+        case rt_err:
+            errnum = rt.errnum;
+            continue;
+        case rt_eof:
+        default:
+            goto done;
+        }
+
+        if (prev == NULL || len != prevlen || memcmp(p, prev, len) != 0) {
+            rawscan_dedup_emit(&o, p, len, delimiterbyte);
+            nout++;
+        }
+        if (p == longline) {                    // keep long line: swap
+            char *t = copy;
+            size_t tcap = copycap;
+
+            copy = longline, copycap = longcap;
+            longline = t, longcap = tcap;
+            p = copy;
+        }
+        prev = p;
+        prevlen = len;
+    }
+
+  done:
+    rawscan_out_flush(&o);
+    if (errnum == 0)
+        errnum = o.errnum;
+    rawscan_pool_put(rsp);
+    free(o.buf);
+    free(copy);
+    free(longline);
+    if (errnum != 0) {
+        errno = errnum;
+        return -1;
+    }
+    return nout;
+}
+
+__unused__ func_static long rs_dedup (
+  int infd,            // read lines from this file descriptor
+  int outfd,           // write lines, less duplicates, here
+  size_t bufsz,        // rawscan input buffer size, per stream
+  char delimiterbyte,  // newline '\n' or other byte marking end of "lines"
+  enum rs_dedup_mode mode,  // rs_dedup_global or rs_dedup_adjacent
+  size_t memsz,        // global: memory for distinct lines (0: default)
+  const char *tmpdir)  // global: directory for spill files (NULL: $TMPDIR, /tmp)
+{
+    if (mode == rs_dedup_adjacent)
+        return rawscan_dedup_adjacent(infd, outfd, bufsz, delimiterbyte);
+    return rawscan_dedup_global(infd, outfd, bufsz, delimiterbyte,
+                                memsz, tmpdir);
+}
+
+/*
+ * rs_partition(): shard lines, by a hash of a key in each, across
+ * nout output files (or pipes, or sockets).
+ *
+ * The key of each line is either one field of it, split by the
+ * key->fieldsep byte (key->field >= 0, counting from 0; an empty
+ * key if the line has fewer fields), or a byte range in it (key->field
+ * < 0), key->length bytes (0: the rest of the line) starting at byte
+ * key->offset.  The line goes to outfds[rs_hash64(key) * nout / 2^64],
+ * so lines with the same key go to the same output, given the same
+ * nout, whichever rawscan program is doing the sharding.
+ *
+ * Each line is copied once, from rs_getline()'s span in the input
+ * buffer, into a RAWSCAN_PARTITION_BUF byte staging buffer for its
+ * output.  When a line doesn't fit, the staged lines and that line
+ * (uncopied) are written together, with one writev(2).  The chunks
+ * of long lines go to the output picked by their first chunk, each
+ * written by the same means.  A line lacking its final delimiterbyte
+ * is output with it.  The input stream is from the stream pool.
+ *
+ * Returns count of lines sharded, or -1, with errno set, if a read or
+ * write failed.
+ */
+
+#ifndef RAWSCAN_PARTITION_BUF
+#define RAWSCAN_PARTITION_BUF (64*1024)
+#endif
+
+struct rawscan_part {
+    int fd;
+    char *buf;                  // staged lines, for fd
+    size_t len;
+};
+
+// writev() all of iov[0 .. iovcnt-1], despite short writes; 0 or errno.
+
+static int rawscan_writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t cnt = writev(fd, iov, iovcnt);
+
+        if (cnt < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        while (iovcnt > 0 && (size_t)cnt >= iov->iov_len) {
+            cnt -= iov->iov_len;
+            iov++, iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + cnt;
+            iov->iov_len -= cnt;
+        }
+    }
+    return 0;
+}
+
+// Append p (len bytes, then *eol, unless eol is NULL) to part; 0 or errno.
+
+static int rawscan_part_append(struct rawscan_part *part,
+                               const char *p, size_t len, const char *eol)
+{
+    size_t need = len + (eol != NULL);
+    struct iovec iov[3];
+    int n = 0;
+
+    if (part->len + need <= RAWSCAN_PARTITION_BUF) {
+        memcpy(part->buf + part->len, p, len);
+        part->len += len;
+        if (eol != NULL)
+            part->buf[part->len++] = *eol;
+        return 0;
+    }
+    if (part->len > 0) {
+        iov[n].iov_base = part->buf;
+        iov[n++].iov_len = part->len;
+    }
+    iov[n].iov_base = (void *)p;
+    iov[n++].iov_len = len;
+    if (eol != NULL) {
+        iov[n].iov_base = (void *)eol;
+        iov[n++].iov_len = 1;
+    }
+    part->len = 0;
+    return rawscan_writev_all(part->fd, iov, n);
+}
+
+// Key span of line [p, p + len), per key.
+
+static void rawscan_part_key(const RAWSCAN_KEYSPEC *key, const char *p,
+                             size_t len, const char **keyp, size_t *keylen)
+{
+    const char *end = p + len, *q;
+    int f;
+
+    if (key->field < 0) {
+        size_t off = key->offset < len ? key->offset : len;
+
+        *keyp = p + off;
+        *keylen = len - off;
+        if (key->length > 0 && key->length < *keylen)
+            *keylen = key->length;
+        return;
+    }
+    for (f = 0; f < key->field; f++) {
+        if ((q = memchr(p, key->fieldsep, end - p)) == NULL) {
+            *keyp = end;                        // no such field: empty
+            *keylen = 0;
+            return;
+        }
+        p = q + 1;
+    }
+    q = memchr(p, key->fieldsep, end - p);
+    *keyp = p;
+    *keylen = (q != NULL ? q : end) - p;
+}
+
+__unused__ func_static long rs_partition (
+  int infd,                  // read lines to shard from this file descriptor
+  const int outfds[],        // write each line to one of these
+  size_t nout,               // how many outfds
+  size_t bufsz,              // rawscan input buffer size
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  const RAWSCAN_KEYSPEC *key)  // which part of each line to hash
+{
+    struct rawscan_part *parts;
+    struct rawscan_part *cur = NULL;            // long line's output
+    RAWSCAN *rsp;
+    RAWSCAN_RESULT rt;
+    char lastbyte = delimiterbyte;              // of long line, so far
+    long nlines = 0;
+    int errnum = 0;
+    size_t i;
+
+    if (nout == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((rsp = rawscan_pool_get(infd, bufsz, delimiterbyte)) == NULL)
+        return -1;
+    if ((parts = calloc(nout, sizeof(*parts))) == NULL) {
+        errnum = ENOMEM;
+        goto done;
+    }
+    for (i = 0; i < nout; i++) {
+        parts[i].fd = outfds[i];
+        if ((parts[i].buf = malloc(RAWSCAN_PARTITION_BUF)) == NULL) {
+            errnum = ENOMEM;
+            goto done;
+        }
+    }
+
+    while (errnum == 0) {
+        const char *keyp;
+        size_t len, keylen;
+
+        rt = rs_getline(rsp);
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+        case rt_start_longline:
+            len = rt.line.end - rt.line.begin + 1;
+            rawscan_part_key(key, rt.line.begin,
+                             len - (rt.type == rt_full_line), &keyp, &keylen);
+            cur = &parts[(size_t)(((__uint128_t)rs_hash64(keyp, keylen)
+                                                        * nout) >> 64)];
+            if (rt.type == rt_start_longline) {
+                lastbyte = *rt.line.end;
+                errnum = rawscan_part_append(cur, rt.line.begin, len, NULL);
+                continue;
+            }
+            errnum = rawscan_part_append(cur, rt.line.begin, len,
+                    rt.type == rt_full_line ? NULL : &rsp->delimiterbyte);
+            nlines++;
+            continue;
+        case rt_within_longline:
+            lastbyte = *rt.line.end;
+            errnum = rawscan_part_append(cur, rt.line.begin,
+                                         rt.line.end - rt.line.begin + 1, NULL);
+            continue;
+        case rt_longline_ended:
+            if (lastbyte != delimiterbyte)
+                errnum = rawscan_part_append(cur, "", 0, &rsp->delimiterbyte);
+            nlines++;
+            continue;
+        case rt_paused:
+            rs_resume_from_pause(rsp);
+            continue;
+        case rt_err:
+            errnum = rt.errnum;
+            continue;
+        case rt_eof:
+            break;
+        }
+        break;
+    }
+
+    for (i = 0; i < nout && errnum == 0; i++) {
+        struct iovec iov;
+
+        if (parts[i].len == 0)
+            continue;
+        iov.iov_base = parts[i].buf;
+        iov.iov_len = parts[i].len;
+        errnum = rawscan_writev_all(parts[i].fd, &iov, 1);
+    }
+
+  done:
+    if (parts != NULL)
+        for (i = 0; i < nout; i++)
+            free(parts[i].buf);
+    free(parts);
+    rawscan_pool_put(rsp);
+    if (errnum != 0) {
+        errno = errnum;
+        return -1;
+    }
+    return nlines;
+}
+
+/*
+ * rs_split(): split a file into pieces of nlines lines (as "split -l")
+ * or of at most nbytes bytes of whole lines (as "split -C").
+ *
+ * Each piece is written to a file descriptor returned by calling
+ * open_piece(arg, i), for the i-th piece (counting from 0), which
+ * rs_split() closes once that piece is written.  The split starts at
+ * infd's current offset; infd must be a regular file.
+ *
+ * The data is moved with copy_file_range(2), so, when the input and
+ * output files are on the same filesystem, it need not pass through
+ * user space at all (and, on filesystems such as XFS and btrfs, may
+ * be reflinked rather than copied).  Where copy_file_range() is not
+ * supported, such as across filesystems on older kernels, or to a
+ * pipe, pread(2) and write(2) are used instead.
+ *
+ * Piece boundaries by bytes (nbytes > 0) are found by reading only
+ * the end of each piece, backward, for its last delimiterbyte, so
+ * most of the data is never read into user space.  A line longer
+ * than nbytes is split, as "split -C" would.  Boundaries by lines
+ * (nlines > 0) need every delimiterbyte counted, which is done by
+ * scanning the input with a rawscan stream (whose rawmemchr() is
+ * vectorized), while the pieces themselves are still copied in the
+ * kernel, as soon as each is found, while in the page cache.  That
+ * stream is from the stream pool.
+ *
+ * Returns count of pieces written, or -1, with errno set, if infd
+ * isn't a regular file, both or neither of nlines and nbytes are
+ * zero, or an open_piece() call, read or write failed.
+ */
+
+#define RAWSCAN_SPLIT_BACKSCAN (64*1024)   // bytes per backward pread
+
+static int rawscan_split_copy(int infd, off_t off, size_t len, int outfd)
+{
+    char *buf;
+
+#ifdef SYS_copy_file_range
+    while (len > 0) {
+        int64_t off_in = off;                   // kernel's loff_t
+        ssize_t cnt = syscall(SYS_copy_file_range, infd, &off_in,
+                              outfd, NULL, len, 0);
+
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS
+                        || errno == EOPNOTSUPP || errno == EBADF))
+            break;                              // do it ourselves, below
+        if (cnt < 0)
+            return errno;
+        if (cnt == 0)
+            return EIO;                         // input shrank under us
+        off += cnt;
+        len -= cnt;
+    }
+    if (len == 0)
+        return 0;
+#endif
+
+    if ((buf = malloc(RAWSCAN_OUTBUF)) == NULL)
+        return ENOMEM;
+    while (len > 0) {
+        ssize_t cnt = pread(infd, buf, len < RAWSCAN_OUTBUF ? len : RAWSCAN_OUTBUF, off);
+        struct iovec iov;
+        int errnum;
+
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt <= 0) {
+            errnum = cnt < 0 ? errno : EIO;
+            free(buf);
+            return errnum;
+        }
+        iov.iov_base = buf;
+        iov.iov_len = cnt;
+        if ((errnum = rawscan_writev_all(outfd, &iov, 1)) != 0) {
+            free(buf);
+            return errnum;
+        }
+        off += cnt;
+        len -= cnt;
+    }
+    free(buf);
+    return 0;
+}
+
+static int rawscan_split_piece(int infd, off_t off, size_t len,
+        rs_split_open_fn open_piece, void *arg, size_t i)
+{
+    int fd, errnum;
+
+    if ((fd = open_piece(arg, i)) < 0)
+        return errno ? errno : EBADF;
+    errnum = rawscan_split_copy(infd, off, len, fd);
+    if (close(fd) < 0 && errnum == 0)
+        errnum = errno;
+    return errnum;
+}
+
+// End of the last line that ends in [start, limit), or limit if none.
+
+static int rawscan_split_backscan(int infd, off_t start, off_t limit,
+                                  char delimiterbyte, off_t *end)
+{
+    char buf[RAWSCAN_SPLIT_BACKSCAN];
+    off_t hi = limit;
+
+    while (hi > start) {
+        off_t lo = hi - start > RAWSCAN_SPLIT_BACKSCAN ?
+                        hi - RAWSCAN_SPLIT_BACKSCAN : start;
+        ssize_t cnt = pread(infd, buf, hi - lo, lo);
+
+        if (cnt < 0 && errno == EINTR)
+            continue;
+        if (cnt < hi - lo)
+            return cnt < 0 ? errno : EIO;
+        while (cnt-- > 0)
+            if (buf[cnt] == delimiterbyte) {
+                *end = lo + cnt + 1;
+                return 0;
+            }
+        hi = lo;
+    }
+    *end = limit;                               // one long line: cut it
+    return 0;
+}
+
+__unused__ func_static long rs_split (
+  int infd,                  // split this file, from its current offset
+  size_t nlines,             // lines per piece, or 0
+  size_t nbytes,             // or, at most this many bytes per piece, or 0
+  size_t bufsz,              // rawscan input buffer size, for nlines
+  char delimiterbyte,        // newline '\n' or other byte marking end of "lines"
+  rs_split_open_fn open_piece, // returns file descriptor for each piece
+  void *arg)                 // passed unchanged to each open_piece() call
+{
+    struct stat st;
+    off_t start, size;
+    size_t npieces = 0;
+    int errnum = 0;
+
+    if ((nlines == 0) == (nbytes == 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fstat(infd, &st) < 0)
+        return -1;
+    if (!S_ISREG(st.st_mode)) {
+        errno = ESPIPE;
+        return -1;
+    }
+    if ((start = lseek(infd, 0, SEEK_CUR)) < 0)
+        return -1;
+    size = st.st_size;
+
+    if (nbytes > 0) {
+        while (start < size && errnum == 0) {
+            off_t end = size;
+
+            if ((size_t)(size - start) > nbytes)
+                errnum = rawscan_split_backscan(infd, start, start + nbytes,
+                                                delimiterbyte, &end);
+            if (errnum == 0)
+                errnum = rawscan_split_piece(infd, start, end - start,
+                                             open_piece, arg, npieces++);
+            start = end;
+        }
+        if (errnum == 0)
+            lseek(infd, start, SEEK_SET);
+    } else {
+        RAWSCAN *rsp;
+        RAWSCAN_RESULT rt;
+        off_t pos = start;
+        size_t n = 0;
+
+        if ((rsp = rawscan_pool_get(infd, bufsz, delimiterbyte)) == NULL)
+            return -1;
+        while (errnum == 0) {
+            rt = rs_getline(rsp);
+            if (rt.type == rt_eof)
+                break;
+            if (rt.type == rt_err) {
+                errnum = rt.errnum;
+                break;
+            }
+            if (rt.type == rt_paused) {
+                rs_resume_from_pause(rsp);
+                continue;
+            }
+            if (rt.type != rt_longline_ended)
+                pos += rt.line.end - rt.line.begin + 1;
+            if (rt.type == rt_start_longline || rt.type == rt_within_longline)
+                continue;
+            if (++n == nlines) {
+                errnum = rawscan_split_piece(infd, start, pos - start,
+                                             open_piece, arg, npieces++);
+                start = pos;
+                n = 0;
+            }
+        }
+        if (errnum == 0 && pos > start)
+            errnum = rawscan_split_piece(infd, start, pos - start,
+                                         open_piece, arg, npieces++);
+        rawscan_pool_put(rsp);
+    }
+
+    if (errnum != 0) {
+        errno = errnum;
+        return -1;
+    }
+    return npieces;
+}
+
+/*
+ * rs_getline_json(rsp, &json): rs_getline() for JSON Lines (JSONL),
+ * also returning a structural index of the record.
+ *
+ * Alongside the record's begin and end, json.structurals[] lists the
+ * offset, from json.begin, of each structural character of the
+ * record, in order: each '{', '}', '[', ']', ':' and ',' outside of
+ * strings, and each '"' that opens or closes a string.  (A string's
+ * value is between its two quote offsets.)  Consumers, such as
+ * rs_json_project(), can walk this index to find keys and values
+ * without tokenizing the record again.  The index, like the record's
+ * bytes, is valid until the next rs_getline_json() call.
+ *
+ * The index is built, as simdjson's first stage does, 64 bytes at a
+ * time: bitmasks of the quotes, backslashes and operator characters
+ * in each 64 byte block are made with vector compares; backslashes
+ * escaping quotes are discounted; the "inside a string" mask is the
+ * prefix xor of the quote mask (carried from block to block); and
+ * the structural positions are read off the resulting bitmask, one
+ * count-trailing-zeros instruction per position.
+ *
+ * Valid JSON can't contain a raw newline within a string, so each line
+ * is ordinarily one record, indexed in place in the stream's buffer.
+ * But if a line ends within a string, the following lines are taken
+ * to be part of that same record, until that string closes.  Such a
+ * record, like a record too long to fit in the buffer in one piece,
+ * is collected in a separate buffer, and returned from there.
+ *
+ * Returns rt_full_line, or rt_full_line_without_eol for a last record
+ * with no final delimiterbyte, or rt_paused, rt_eof or rt_err, as
+ * rs_getline() would.  json.unclosed is set if the input ended
+ * within a string.  A read error returns rt_err, with its errnum,
+ * even partway through collecting a record, which is then dropped.
+ * Offsets are 32 bits, so records are limited to 4 GBytes.
+ */
+
+struct rawscan_json {
+    uint32_t *structurals;
+    size_t cap;                 // room in structurals[]
+    size_t n;
+    char *rec;                  // record collected from chunks or lines
+    size_t reclen, reccap;
+    uint64_t escaped_carry;     // next block's first byte is escaped
+    uint64_t instring_carry;    // all ones if block starts in a string
+};
+
+static void rawscan_json_free(RAWSCAN *rsp)
+{
+    if (rsp->json == NULL)
+        return;
+    free(rsp->json->structurals);
+    free(rsp->json->rec);
+    free(rsp->json);
+    rsp->json = NULL;
+}
+
+// Bitmasks of the quotes, backslashes and operators in 64 bytes at p.
+
+static inline void rawscan_json_masks(const char *p, uint64_t *quote,
+                                      uint64_t *backslash, uint64_t *ops)
+{
+#if defined(__AVX2__)
+    int i;
+
+    *quote = *backslash = *ops = 0;
+    for (i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i o = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+        *quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        *backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        *ops |= (uint64_t)(uint32_t)_mm256_movemask_epi8(o) << i;
+    }
+#elif defined(__SSE2__)
+    int i;
+
+    *quote = *backslash = *ops = 0;
+    for (i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i o = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(']')))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+        *quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        *backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        *ops |= (uint64_t)(uint16_t)_mm_movemask_epi8(o) << i;
+    }
+#else
+    int i;
+
+    *quote = *backslash = *ops = 0;
+    for (i = 0; i < 64; i++) {
+        unsigned char c = p[i];
+
+        *quote |= (uint64_t)(c == '"') << i;
+        *backslash |= (uint64_t)(c == '\\') << i;
+        *ops |= (uint64_t)(c == '{' || c == '}' || c == '[' || c == ']'
+                                    || c == ':' || c == ',') << i;
+    }
+#endif
+}
+
+// Index the len bytes at p, which are at offset base in the record.
+
+static void rawscan_json_scan(struct rawscan_json *js, const char *p,
+                              size_t len, size_t base)
+{
+    char tail[64];
+    size_t off;
+
+    for (off = 0; off < len; off += 64) {
+        uint64_t quote, backslash, ops, escaped, instring, structural, b;
+        const char *blk = p + off;
+
+        if (len - off < 64) {                   // pad last partial block
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, blk, len - off);
+            blk = tail;
+        }
+        rawscan_json_masks(blk, &quote, &backslash, &ops);
+
+        // Each backslash not itself escaped escapes the next byte.
+        escaped = js->escaped_carry;
+        js->escaped_carry = 0;
+        for (b = backslash & ~escaped; b != 0; ) {
+            int i = __builtin_ctzll(b);
+
+            if (i == 63)
+                js->escaped_carry = 1;
+            else
+                escaped |= UINT64_C(1) << (i + 1);
+            b &= ~(UINT64_C(3) << i);           // the escaped byte too
+        }
+        quote &= ~escaped;
+
+        // Inside a string: from each opening quote up to its close.
+        instring = quote;
+        instring ^= instring << 1;
+        instring ^= instring << 2;
+        instring ^= instring << 4;
+        instring ^= instring << 8;
+        instring ^= instring << 16;
+        instring ^= instring << 32;
+        instring ^= js->instring_carry;
+        js->instring_carry = (uint64_t)((int64_t)instring >> 63);
+
+        structural = (ops & ~instring) | quote;
+        if (len - off < 64)
+            structural &= (UINT64_C(1) << (len - off)) - 1;
+        while (structural != 0) {
+            js->structurals[js->n++] = base + off + __builtin_ctzll(structural);
+            structural &= structural - 1;
+        }
+    }
+}
+
+static int rawscan_json_reserve(struct rawscan_json *js, size_t reclen)
+{
+    if (reclen > UINT32_MAX)
+        return EFBIG;
+    if (reclen > js->cap) {
+        size_t cap = js->cap ? js->cap : 4096;
+        uint32_t *structurals;
+
+        while (cap < reclen)
+            cap *= 2;
+        if ((structurals = realloc(js->structurals,
+                                   cap * sizeof(*structurals))) == NULL)
+            return ENOMEM;
+        js->structurals = structurals;
+        js->cap = cap;
+    }
+    return 0;
+}
+
+static int rawscan_json_append(struct rawscan_json *js, const char *p, size_t len)
+{
+    if (js->reclen + len > js->reccap) {
+        size_t cap = js->reccap ? js->reccap : 4096;
+        char *rec;
+
+        while (cap < js->reclen + len)
+            cap *= 2;
+        if ((rec = realloc(js->rec, cap)) == NULL)
+            return ENOMEM;
+        js->rec = rec;
+        js->reccap = cap;
+    }
+    memcpy(js->rec + js->reclen, p, len);
+    js->reclen += len;
+    return 0;
+}
+
+// rs_getline_json(), skipping any single line record for which
+// skip(arg, line, len) returns true.  That's only known to be a whole
+// record once indexed, as a line ending within a string continues on
+// the next line, so the skip is tried after indexing, but before the
+// caller walks that index.
+
+static RAWSCAN_RESULT rawscan_getline_json(RAWSCAN *rsp, RAWSCAN_JSON *jp,
+        bool (*skip)(const void *arg, const char *p, size_t len), const void *arg)
+{
+    struct rawscan_json *js = rsp->json;
+    RAWSCAN_RESULT rt;
+    bool collecting = false;    // record is in js->rec, not rsp's buffer
+    size_t scanned = 0;         // bytes of js->rec indexed so far
+    int errnum;
+
+    if (js == NULL && (js = rsp->json = calloc(1, sizeof(*js))) == NULL) {
+        rt.type = rt_err;
+        rt.errnum = ENOMEM;
+        return rt;
+    }
+    js->n = js->reclen = 0;
+    js->escaped_carry = js->instring_carry = 0;
+    jp->unclosed = false;
+
+    for (;;) {
+        size_t len;
+
+        rt = rs_getline(rsp);
+        switch (rt.type) {
+        case rt_paused:
+            if (!collecting)
+                return rt;
+            rs_resume_from_pause(rsp);
+            continue;
+        case rt_err:                            // (even within a record)
+            return rt;
+        case rt_eof:
+            if (!collecting)
+                return rt;
+            jp->unclosed = true;                // input ended in a string
+            rt.type = rt_full_line_without_eol;
+            goto done;
+        case rt_start_longline:
+        case rt_within_longline:
+            collecting = true;
+            if ((errnum = rawscan_json_append(js, rt.line.begin,
+                                rt.line.end - rt.line.begin + 1)) != 0)
+                goto fail;
+            continue;
+        case rt_longline_ended:
+            rt.type = js->rec[js->reclen - 1] == rsp->delimiterbyte ?
+                                rt_full_line : rt_full_line_without_eol;
+            break;
+        case rt_full_line:
+        case rt_full_line_without_eol:
+            len = rt.line.end - rt.line.begin + 1;
+            if (!collecting) {                  // index in place
+                if ((errnum = rawscan_json_reserve(js, len)) != 0)
+                    goto fail;
+                rawscan_json_scan(js, rt.line.begin, len, 0);
+                if (js->instring_carry == 0 || rt.type != rt_full_line) {
+                    if (skip != NULL && skip(arg, rt.line.begin, len)) {
+                        js->n = 0;
+                        js->escaped_carry = js->instring_carry = 0;
+                        continue;
+                    }
+                    jp->begin = rt.line.begin;
+                    jp->end = rt.line.end;
+                    jp->unclosed = js->instring_carry != 0;
+                    goto out;
+                }
+                // Newline within a string: collect following lines too.
+                collecting = true;
+                if ((errnum = rawscan_json_append(js, rt.line.begin, len)) != 0)
+                    goto fail;
+                scanned = js->reclen;
+                continue;
+            }
+            if ((errnum = rawscan_json_append(js, rt.line.begin, len)) != 0)
+                goto fail;
+            break;
+        }
+
+        // js->rec holds more of the record: index what's new.
+        if ((errnum = rawscan_json_reserve(js, js->reclen)) != 0)
+            goto fail;
+        rawscan_json_scan(js, js->rec + scanned, js->reclen - scanned, scanned);
+        scanned = js->reclen;
+        if (js->instring_carry == 0 || rt.type != rt_full_line)
+            break;
+    }
+    jp->unclosed = js->instring_carry != 0;
+
+  done:
+    jp->begin = js->rec;
+    jp->end = js->rec + js->reclen - 1;
+
+  out:
+    jp->structurals = js->structurals;
+    jp->nstructurals = js->n;
+    rt.line.begin = jp->begin;
+    rt.line.end = jp->end;
+    return rt;
+
+  fail:
+    rt.type = rt_err;
+    rt.errnum = errnum;
+    return rt;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_getline_json(RAWSCAN *rsp,
+                                                     RAWSCAN_JSON *jp)
+{
+    return rawscan_getline_json(rsp, jp, NULL, NULL);
+}
+
+/*
+ * rs_json_paths_open(), rs_json_project(), rs_getline_projected():
+ * pick out just the values of a few keys from each JSONL record.
+ *
+ * rs_json_paths_open(paths, npaths, required) compiles up to 64 key
+ * paths, such as "user.id" (key "id" within the object that is the
+ * value of key "user" of the record's top level object).  Path
+ * components are matched byte for byte against keys as they appear
+ * in the record, escapes and all.
+ *
+ * rs_json_project(json, pp, values) walks the structural index of a
+ * record returned by rs_getline_json(), without building any tree,
+ * setting values[i] to the span of the value of paths[i], from its
+ * first byte to its last byte (strings include their quotes; nothing
+ * is unescaped), or to NULL begin and end if that path is absent.
+ * Returns count of paths found.  Only objects on the way to some
+ * path are descended into.  Other values, however large, are stepped
+ * over in the index, from their opening '{' or '[' to its matching
+ * close, never looking at the record's bytes in between.  The walk
+ * stops as soon as every path has been found.
+ *
+ * rs_getline_projected(rsp, pp, json, values) is rs_getline_json()
+ * followed by rs_json_project(), returning just those records having
+ * all the paths in the required bitmask (bit i for paths[i]) given
+ * to rs_json_paths_open().  A single line record that doesn't
+ * contain the last component of each required path, in quotes,
+ * somewhere in it, is skipped by a memmem() check as soon as it has
+ * been indexed (which tells whether the line ends within a string,
+ * so that the record goes on), without walking that index, so that
+ * records lacking a required key cost little more than finding them.
+ */
+
+struct rawscan_json_path {
+    const char **comps;         // path split at '.'
+    size_t *complens;
+    size_t ncomps;
+};
+
+struct RAWSCAN_JSONPATHS {
+    struct rawscan_json_path *paths;
+    size_t npaths;
+    uint64_t all;               // bit for each path
+    uint64_t required;          // bits for required paths
+    char *strs;                 // paths' components, and quoted leaves
+    const char **leafpats;      // "leaf", with quotes, per required path
+    size_t *leafpatlens;
+};
+
+__unused__ func_static void rs_json_paths_close(RAWSCAN_JSONPATHS *pp)
+{
+    size_t i;
+
+    if (pp == NULL)
+        return;
+    if (pp->paths != NULL)
+        for (i = 0; i < pp->npaths; i++) {
+            free(pp->paths[i].comps);
+            free(pp->paths[i].complens);
+        }
+    free(pp->paths);
+    free(pp->leafpats);
+    free(pp->leafpatlens);
+    free(pp->strs);
+    free(pp);
+}
+
+__unused__ func_static RAWSCAN_JSONPATHS *rs_json_paths_open (
+  const char *const paths[], // key paths, components separated by '.'
+  size_t npaths,             // how many paths (at most 64)
+  uint64_t required)         // bit i set: skip records lacking paths[i]
+{
+    RAWSCAN_JSONPATHS *pp;
+    size_t i, total = 0;
+    char *q;
+
+    if (npaths > 64) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for (i = 0; i < npaths; i++)
+        total += 2 * strlen(paths[i]) + 3;
+    if ((pp = calloc(1, sizeof(*pp))) == NULL
+            || (pp->paths = calloc(npaths ? npaths : 1, sizeof(*pp->paths))) == NULL
+            || (pp->leafpats = calloc(npaths ? npaths : 1, sizeof(*pp->leafpats))) == NULL
+            || (pp->leafpatlens = calloc(npaths ? npaths : 1, sizeof(size_t))) == NULL
+            || (pp->strs = malloc(total ? total : 1)) == NULL)
+        goto fail;
+    pp->npaths = npaths;
+    pp->all = npaths == 64 ? ~UINT64_C(0) : (UINT64_C(1) << npaths) - 1;
+    pp->required = required & pp->all;
+
+    q = pp->strs;
+    for (i = 0; i < npaths; i++) {
+        struct rawscan_json_path *path = &pp->paths[i];
+        size_t len = strlen(paths[i]), n = 1, c;
+        const char *comp;
+
+        for (c = 0; c < len; c++)
+            n += paths[i][c] == '.';
+        if ((path->comps = calloc(n, sizeof(*path->comps))) == NULL
+                || (path->complens = calloc(n, sizeof(size_t))) == NULL)
+            goto fail;
+        path->ncomps = n;
+        memcpy(q, paths[i], len + 1);
+        for (comp = q, c = 0; c < n; c++) {
+            const char *dot = strchr(comp, '.');
+            size_t clen = dot != NULL ? (size_t)(dot - comp) : strlen(comp);
+
+            path->comps[c] = comp;
+            path->complens[c] = clen;
+            comp += clen + 1;
+        }
+        q += len + 1;
+
+        // "leaf", quoted, for rs_getline_projected()'s memmem() check
+        pp->leafpats[i] = q;
+        pp->leafpatlens[i] = path->complens[n - 1] + 2;
+        *q++ = '"';
+        memcpy(q, path->comps[n - 1], path->complens[n - 1]);
+        q += path->complens[n - 1];
+        *q++ = '"';
+    }
+    return pp;
+
+  fail:
+    rs_json_paths_close(pp);
+    errno = ENOMEM;
+    return NULL;
+}
+
+// Index of the '}' or ']' closing the '{' or '[' at structurals[i].
+
+static size_t rawscan_json_skip(const char *b, const uint32_t *s,
+                                size_t n, size_t i)
+{
+    size_t depth = 0;
+
+    for (; i < n; i++) {
+        char c = b[s[i]];
+
+        if (c == '{' || c == '[')
+            depth++;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return i;
+    }
+    return n;                                   // unbalanced: ran off end
+}
+
+static bool rawscan_json_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Walk the object opened at structurals[*ip], looking for the paths in
+// cand at this depth; leave *ip at its close.  Returns true once every
+// path has been found, to stop the walk.
+
+static bool rawscan_json_walk(const RAWSCAN_JSON *jp, size_t *ip,
+        const RAWSCAN_JSONPATHS *pp, uint64_t cand, size_t depth,
+        RAWSCAN_SPAN values[], uint64_t *found)
+{
+    const char *b = jp->begin;
+    const uint32_t *s = jp->structurals;
+    size_t n = jp->nstructurals, i = *ip + 1;
+
+    while (i + 2 < n && b[s[i]] == '"' && b[s[i + 2]] == ':') {
+        const char *key = b + s[i] + 1;
+        size_t keylen = s[i + 1] - s[i] - 1;
+        const char *vbegin, *vend;
+        uint64_t leaf = 0, deeper = 0, m;
+
+        i += 3;
+        for (m = cand & ~*found; m != 0; m &= m - 1) {
+            const struct rawscan_json_path *path =
+                                &pp->paths[__builtin_ctzll(m)];
+
+            if (path->complens[depth] == keylen
+                    && memcmp(path->comps[depth], key, keylen) == 0) {
+                if (depth + 1 == path->ncomps)
+                    leaf |= m & -m;
+                else
+                    deeper |= m & -m;
+            }
+        }
+
+        if (i >= n)
+            break;
+        if (b[s[i]] == '{' || b[s[i]] == '[') {
+            size_t open = i;
+
+            vbegin = b + s[i];
+            if (deeper != 0 && b[s[i]] == '{'
+                    && rawscan_json_walk(jp, &i, pp, deeper, depth + 1,
+                                         values, found)) {
+                if (leaf == 0)
+                    return true;
+                i = rawscan_json_skip(b, s, n, open);   // stopped short
+            } else if (deeper == 0 || b[s[i]] != '{') {
+                i = rawscan_json_skip(b, s, n, open);
+            }
+            if (i >= n)
+                break;
+            vend = b + s[i];
+            i++;
+        } else if (b[s[i]] == '"' && i + 1 < n) {
+            vbegin = b + s[i];
+            vend = b + s[i + 1];
+            i += 2;
+        } else {                                // number, true, false, null
+            vbegin = b + s[i - 1] + 1;
+            vend = b + s[i] - 1;
+            while (vbegin <= vend && rawscan_json_space(*vbegin))
+                vbegin++;
+            while (vend >= vbegin && rawscan_json_space(*vend))
+                vend--;
+        }
+
+        for (m = leaf; m != 0; m &= m - 1) {
+            values[__builtin_ctzll(m)].begin = vbegin;
+            values[__builtin_ctzll(m)].end = vend;
+        }
+        *found |= leaf;
+        if (*found == pp->all)
+            return true;
+
+        if (i >= n || b[s[i]] != ',')
+            break;
+        i++;
+    }
+    *ip = i;
+    return false;
+}
+
+__unused__ func_static size_t rs_json_project(const RAWSCAN_JSON *jp,
+                        const RAWSCAN_JSONPATHS *pp, RAWSCAN_SPAN values[])
+{
+    uint64_t found = 0;
+    size_t i = 0;
+
+    for (i = 0; i < pp->npaths; i++)
+        values[i].begin = values[i].end = NULL;
+    i = 0;
+    if (jp->nstructurals > 0 && jp->begin[jp->structurals[0]] == '{')
+        rawscan_json_walk(jp, &i, pp, pp->all, 0, values, &found);
+    return __builtin_popcountll(found);
+}
+
+// Skip a line that lacks some required path's last key, in quotes.
+
+static bool rawscan_json_lacks_required(const void *arg, const char *p, size_t len)
+{
+    const RAWSCAN_JSONPATHS *pp = arg;
+    uint64_t m;
+
+    for (m = pp->required; m != 0; m &= m - 1) {
+        size_t k = __builtin_ctzll(m);
+
+        if (memmem(p, len, pp->leafpats[k], pp->leafpatlens[k]) == NULL)
+            return true;
+    }
+    return false;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_getline_projected(RAWSCAN *rsp,
+        const RAWSCAN_JSONPATHS *pp, RAWSCAN_JSON *jp, RAWSCAN_SPAN values[])
+{
+    RAWSCAN_RESULT rt;
+    uint64_t found;
+    size_t k;
+
+    for (;;) {
+        rt = rawscan_getline_json(rsp, jp, pp->required != 0 ?
+                                rawscan_json_lacks_required : NULL, pp);
+        if (rt.type != rt_full_line && rt.type != rt_full_line_without_eol)
+            return rt;
+        rs_json_project(jp, pp, values);
+        for (found = 0, k = 0; k < pp->npaths; k++)
+            if (values[k].begin != NULL)
+                found |= UINT64_C(1) << k;
+        if ((found & pp->required) == pp->required)
+            return rt;
+    }
+}
+
+/*
+ * rs_logfmt_parse(), rs_syslog_parse(): split logfmt and RFC 5424
+ * syslog lines into spans, without copying.
+ *
+ * rs_logfmt_parse(p, len, kvs, maxkvs) splits the len bytes at p (a
+ * line, less its delimiterbyte) into logfmt "key=value" pairs, such
+ * as:  level=info msg="disk full" path=/var retry=3 dryrun
+ * setting kvs[i].key and kvs[i].value to the spans of the i-th key
+ * and value, for the first maxkvs pairs, and returning count of all
+ * pairs on the line.  A quoted value's span excludes its quotes, and
+ * any backslash escapes in it are left as is.  A key with no "=" (a
+ * boolean flag, like "dryrun" above) gets a NULL value begin and end.
+ * A key with "=" but no value gets an empty value, with end one byte
+ * before begin.  (As with lines, the length of a span is end - begin
+ * + 1.)
+ *
+ * rs_syslog_parse(p, len, sp) splits an RFC 5424 syslog line:
+ *   <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD [MSG]
+ * setting sp's priority and version numbers and the spans of the
+ * other fields (a "-" NILVALUE field has its "-" as its span; an
+ * absent MSG has NULL begin and end), and parsing the RFC 3339
+ * timestamp into sp->time_ns, nanoseconds since the Unix epoch (0 if
+ * NILVALUE).  Returns 0, or -1 if the line isn't RFC 5424 syslog.
+ * The MSG of many services is itself logfmt, for rs_logfmt_parse().
+ *
+ * The spaces, '=' and '"' bounding keys and values, and the '"' and
+ * '\' within quoted values, are found with rawscan_find3(), which
+ * compares 32 or 16 bytes at once, with AVX2 or SSE2, where the
+ * compiler targets those, rather than one byte at a time.
+ */
+
+// First byte in [p, end) that is a, b or c, or end if none.
+
+static inline const char *rawscan_find3(const char *p, const char *end,
+                                        char a, char b, char c)
+{
+#if defined(__AVX2__)
+    const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b),
+                  vc = _mm256_set1_epi8(c);
+
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t m = _mm256_movemask_epi8(_mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+                _mm256_cmpeq_epi8(v, vc)));
+
+        if (m != 0)
+            return p + __builtin_ctz(m);
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b),
+                      vc = _mm_set1_epi8(c);
+
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            unsigned m = _mm_movemask_epi8(_mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+                    _mm_cmpeq_epi8(v, vc)));
+
+            if (m != 0)
+                return p + __builtin_ctz(m);
+        }
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == a || *p == b || *p == c)
+            return p;
+    return end;
+}
+
+// Closing quote of the quoted string whose contents begin at p, or end.
+
+static const char *rawscan_close_quote(const char *p, const char *end)
+{
+    for (;;) {
+        p = rawscan_find3(p, end, '"', '\\', '"');
+        if (p >= end || *p == '"')
+            return p;
+        p += 2;                                 // step over escaped byte
+        if (p > end)
+            return end;
+    }
+}
+
+__unused__ func_static size_t rs_logfmt_parse(const char *p, size_t len,
+                                             RAWSCAN_KV kvs[], size_t maxkvs)
+{
+    const char *end = p + len;
+    size_t n = 0;
+
+    for (;;) {
+        const char *key, *q;
+        RAWSCAN_SPAN value;
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p >= end)
+            return n;
+
+        key = p;
+        q = rawscan_find3(p, end, ' ', '=', '\t');
+        if (q < end && *q == '=') {
+            const char *v = q + 1;
+
+            if (v < end && *v == '"') {
+                const char *close = rawscan_close_quote(v + 1, end);
+
+                value.begin = v + 1;
+                value.end = close - 1;
+                p = close < end ? close + 1 : end;
+            } else {
+                const char *sp = rawscan_find3(v, end, ' ', '\t', ' ');
+
+                value.begin = v;
+                value.end = sp - 1;
+                p = sp;
+            }
+        } else {
+            value.begin = value.end = NULL;     // bare key: a flag
+            p = q;
+        }
+        if (n < maxkvs) {
+            kvs[n].key.begin = key;
+            kvs[n].key.end = q - 1;
+            kvs[n].value = value;
+        }
+        n++;
+    }
+}
+
+// Parse n decimal digits at p into *val; false if not all digits.
+
+static bool rawscan_digits(const char *p, int n, int *val)
+{
+    int v = 0;
+
+    while (n-- > 0) {
+        if (*p < '0' || *p > '9')
+            return false;
+        v = v * 10 + (*p++ - '0');
+    }
+    *val = v;
+    return true;
+}
+
+// Days in month m (1 .. 12) of year y (proleptic Gregorian).
+
+static int rawscan_days_in_month(int y, int m)
+{
+    static const unsigned char mdays[12] =
+            { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if (m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))
+        return 29;
+    return mdays[m - 1];
+}
+
+// Days from 1970-01-01 to y-m-d (proleptic Gregorian).
+
+static int64_t rawscan_days_from_civil(int y, int m, int d)
+{
+    int64_t era, yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Parse RFC 3339 "YYYY-MM-DDTHH:MM:SS[.frac](Z|+hh:mm|-hh:mm)".  If
+// not strict, also allow a space for the 'T', and no zone, for UTC.
+
+static bool rawscan_parse_rfc3339(const char *p, size_t len, int64_t *ns,
+                                  bool strict)
+{
+    const char *end = p + len;
+    int y, mo, d, h, mi, s, oh, om;
+    int64_t frac = 0, scale = 1000000000, offset = 0;
+
+    if (len < 19 || !rawscan_digits(p, 4, &y) || p[4] != '-'
+            || !rawscan_digits(p + 5, 2, &mo) || p[7] != '-'
+            || !rawscan_digits(p + 8, 2, &d)
+            || (p[10] != 'T' && p[10] != 't' && (strict || p[10] != ' '))
+            || !rawscan_digits(p + 11, 2, &h) || p[13] != ':'
+            || !rawscan_digits(p + 14, 2, &mi) || p[16] != ':'
+            || !rawscan_digits(p + 17, 2, &s)
+            || mo < 1 || mo > 12 || d < 1 || d > rawscan_days_in_month(y, mo)
+            || h > 23 || mi > 59 || s > 60)
+        return false;
+    p += 19;
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            if (scale > 1) {
+                scale /= 10;
+                frac += (*p - '0') * scale;
+            }
+    }
+    if (p < end && (*p == 'Z' || *p == 'z')) {
+        p++;
+    } else if (end - p >= 6 && (*p == '+' || *p == '-')
+                && rawscan_digits(p + 1, 2, &oh) && p[3] == ':'
+                && rawscan_digits(p + 4, 2, &om)) {
+        offset = (oh * 60 + om) * 60 * (*p == '+' ? 1 : -1);
+        p += 6;
+    } else if (strict || p != end) {
+        return false;
+    }
+    if (p != end)
+        return false;
+    *ns = ((rawscan_days_from_civil(y, mo, d) * 86400
+            + h * 3600 + mi * 60 + s - offset) * 1000000000) + frac;
+    return true;
+}
+
+// Span of the space separated field at *pp; advance *pp past it.
+
+static bool rawscan_syslog_field(const char **pp, const char *end,
+                                 RAWSCAN_SPAN *field)
+{
+    const char *p = *pp, *sp;
+
+    if (p >= end)
+        return false;
+    sp = rawscan_find3(p, end, ' ', ' ', ' ');
+    if (sp == p)
+        return false;
+    field->begin = p;
+    field->end = sp - 1;
+    *pp = sp < end ? sp + 1 : end;
+    return true;
+}
+
+__unused__ func_static int rs_syslog_parse(const char *p, size_t len,
+                                          RAWSCAN_SYSLOG *sp)
+{
+    const char *end = p + len, *q;
+    int pri = 0;
+
+    memset(sp, 0, sizeof(*sp));
+
+    // <PRI>VERSION
+    if (p >= end || *p++ != '<')
+        return -1;
+    for (q = p; p < end && p - q < 3 && *p >= '0' && *p <= '9'; p++)
+        pri = pri * 10 + (*p - '0');
+    if (p == q || p >= end || *p++ != '>' || pri > 191)
+        return -1;
+    sp->priority = pri;
+    for (q = p; p < end && p - q < 3 && *p >= (p == q ? '1' : '0')
+                                                && *p <= '9'; p++)
+        sp->version = sp->version * 10 + (*p - '0');   // 1-9, then 0-9
+    if (p == q || p >= end || *p++ != ' ')
+        return -1;
+
+    if (!rawscan_syslog_field(&p, end, &sp->timestamp)
+            || !rawscan_syslog_field(&p, end, &sp->hostname)
+            || !rawscan_syslog_field(&p, end, &sp->appname)
+            || !rawscan_syslog_field(&p, end, &sp->procid)
+            || !rawscan_syslog_field(&p, end, &sp->msgid))
+        return -1;
+    if (!(sp->timestamp.begin == sp->timestamp.end
+                    && *sp->timestamp.begin == '-')
+            && !rawscan_parse_rfc3339(sp->timestamp.begin,
+                    sp->timestamp.end - sp->timestamp.begin + 1, &sp->time_ns, true))
+        return -1;
+
+    // STRUCTURED-DATA: "-", or one or more [id param="value" ...]
+    if (p >= end)
+        return -1;
+    sp->structured_data.begin = p;
+    if (*p == '-') {
+        p++;
+    } else {
+        while (p < end && *p == '[') {
+            for (p++; p < end && *p != ']'; ) {
+                q = rawscan_find3(p, end, '"', ']', ']');
+                if (q < end && *q == '"') {
+                    q = rawscan_close_quote(q + 1, end);
+                    if (q < end)
+                        q++;
+                }
+                p = q;
+            }
+            if (p >= end)
+                return -1;                      // unclosed [
+            p++;
+        }
+        if (p == sp->structured_data.begin)
+            return -1;
+    }
+    sp->structured_data.end = p - 1;
+
+    // [SP MSG]
+    if (p < end) {
+        if (*p++ != ' ')
+            return -1;
+        if (p < end) {
+            sp->msg.begin = p;
+            sp->msg.end = end - 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * rs_getcolumns(): parse numeric and timestamp fields of a batch of
+ * lines into typed column arrays.
+ *
+ * rs_getcolumns(rsp, fieldsep, cols, ncols, maxrows, &nrows) reads up
+ * to maxrows lines from rsp, splits each at fieldsep bytes, and parses
+ * field cols[i].field of the r-th line into cols[i].values[r], as an
+ * int64_t (rs_col_int64), a double (rs_col_double), or an int64_t of
+ * nanoseconds since the Unix epoch (rs_col_time, from an RFC 3339 or
+ * "YYYY-MM-DD HH:MM:SS[.frac]" UTC timestamp), setting cols[i].valid[r]
+ * to 1, or to 0 (and the value to 0, or NaN) if that field is missing,
+ * empty or not parsable.  Sets *nrows to the count of rows filled, and
+ * returns the RAWSCAN_RESULT of the last line, or the rt_eof, rt_err
+ * or rt_paused that ended the batch short.  maxrows must be at least
+ * 1: with 0, there being no last line, rt_err is returned, with errnum
+ * EINVAL.  Timestamps must name a real day, such as February 29th of
+ * a leap year, else they aren't parsable.  Long lines, which rs_getline
+ * returns in chunks, are skipped.  Aggregations can then run over each
+ * column's contiguous array, instead of calling strtol(), strtod() or
+ * strptime() per field, per line.
+ *
+ * Digits are parsed eight at a time with SWAR ("SIMD within a
+ * register") multiplies on little-endian targets, after finding the
+ * length of the digit run 16 bytes at a time with SSE2.  Doubles with
+ * at most 19 significant digits and a power of ten exponent within
+ * +/-22 are exact as one multiply or divide of two exact doubles
+ * (Clinger's fast path); any others fall back to strtod().
+ */
+
+// Length of the run of ASCII digits at p, up to end.
+
+static inline size_t rawscan_digit_run(const char *p, const char *end)
+{
+    const char *q = p;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_set1_epi8('0'), nine = _mm_set1_epi8(9);
+
+    for (; end - q >= 16; q += 16) {
+        __m128i d = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)q), zero);
+        unsigned m = ~_mm_movemask_epi8(
+                _mm_cmpeq_epi8(_mm_min_epu8(d, nine), d)) & 0xFFFF;
+
+        if (m != 0)
+            return q - p + __builtin_ctz(m);
+    }
+#endif
+    while (q < end && (unsigned char)(*q - '0') < 10)
+        q++;
+    return q - p;
+}
+
+static const uint64_t rawscan_pow10_u64[20] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+    1000000000, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+    10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+static const double rawscan_pow10_dbl[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// Value of the 8 ASCII digits in v, the first digit in its low byte.
+
+static inline uint64_t rawscan_swar8(uint64_t v)
+{
+    v -= UINT64_C(0x3030303030303030);
+    v = v * 10 + (v >> 8);
+    return ((v & UINT64_C(0x000000FF000000FF)) * UINT64_C(0x000F424000000064)
+            + ((v >> 16) & UINT64_C(0x000000FF000000FF))
+              * UINT64_C(0x0000271000000001)) >> 32;
+}
+#endif
+
+// Value of the n <= 19 ASCII digits at p.
+
+static inline uint64_t rawscan_parse_digits(const char *p, size_t n)
+{
+    uint64_t v = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t w;
+
+    for (; n >= 8; p += 8, n -= 8) {
+        memcpy(&w, p, 8);
+        v = v * 100000000 + rawscan_swar8(w);
+    }
+    if (n > 0) {
+        w = UINT64_C(0x3030303030303030);       // pad with leading '0's
+        memcpy((char *)&w + 8 - n, p, n);
+        v = v * rawscan_pow10_u64[n] + rawscan_swar8(w);
+    }
+#else
+    while (n-- > 0)
+        v = v * 10 + (*p++ - '0');
+#endif
+    return v;
+}
+
+static bool rawscan_parse_int64(const char *p, const char *end, int64_t *out)
+{
+    bool neg = false;
+    size_t n;
+    uint64_t v;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    n = rawscan_digit_run(p, end);
+    if (n == 0 || p + n != end)
+        return false;
+    for (; n > 1 && *p == '0'; n--)
+        p++;
+    if (n > 19)
+        return false;
+    v = rawscan_parse_digits(p, n);
+    if (v > (uint64_t)INT64_MAX + neg)
+        return false;
+    *out = neg ? (int64_t)(0 - v) : (int64_t)v;
+    return true;
+}
+
+static bool rawscan_parse_double(const char *p, const char *end, double *out)
+{
+    const char *b = p, *ip, *fp = NULL;
+    size_t ni, nf = 0;
+    int exp10 = 0;
+    bool neg = false;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    ip = p;
+    p += ni = rawscan_digit_run(p, end);
+    if (p < end && *p == '.') {
+        fp = ++p;
+        p += nf = rawscan_digit_run(p, end);
+    }
+    if (ni + nf == 0)
+        goto slow;                              // inf, nan, hex, junk ...
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        bool eneg = false;
+        size_t ne;
+
+        if (++p < end && (*p == '-' || *p == '+'))
+            eneg = *p++ == '-';
+        ne = rawscan_digit_run(p, end);
+        if (ne == 0 || ne > 4)
+            goto slow;
+        exp10 = (int)rawscan_parse_digits(p, ne);
+        if (eneg)
+            exp10 = -exp10;
+        p += ne;
+    }
+    if (p != end)
+        return false;
+    for (; ni > 0 && *ip == '0'; ni--)
+        ip++;
+    if (ni == 0)
+        for (; nf > 0 && *fp == '0'; nf--, exp10--)
+            fp++;                               // 0.000123: 123e-6
+    if (ni + nf <= 19) {
+        uint64_t m = rawscan_parse_digits(ip, ni) * rawscan_pow10_u64[nf]
+                     + (nf > 0 ? rawscan_parse_digits(fp, nf) : 0);
+
+        exp10 -= (int)nf;
+        if (m == 0) {
+            *out = neg ? -0.0 : 0.0;
+            return true;
+        }
+        if (m <= (UINT64_C(1) << 53) && exp10 >= -22 && exp10 <= 22) {
+            double d = (double)m;
+
+            d = exp10 < 0 ? d / rawscan_pow10_dbl[-exp10]
+                          : d * rawscan_pow10_dbl[exp10];
+            *out = neg ? -d : d;
+            return true;
+        }
+    }
+
+slow:
+    {
+        char buf[128], *ep;
+
+        if ((size_t)(end - b) >= sizeof(buf))
+            return false;
+        memcpy(buf, b, end - b);
+        buf[end - b] = '\0';
+        *out = strtod(buf, &ep);
+        return ep == buf + (end - b) && ep != buf;
+    }
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_getcolumns(RAWSCAN *rsp,
+        char fieldsep, const RAWSCAN_COLUMN cols[], size_t ncols,
+        size_t maxrows, size_t *nrows)
+{
+    RAWSCAN_RESULT rt;
+    RAWSCAN_SPAN *fields;
+    size_t r = 0, i;
+    int maxfield = 0;
+
+    memset(&rt, 0, sizeof(rt));
+    *nrows = 0;
+    if (maxrows == 0) {                         // no line to return
+        rt.type = rt_err;
+        rt.errnum = EINVAL;
+        return rt;
+    }
+    for (i = 0; i < ncols; i++)
+        if (cols[i].field > maxfield)
+            maxfield = cols[i].field;
+    if ((fields = malloc((maxfield + 1) * sizeof(*fields))) == NULL) {
+        rt.type = rt_err;
+        rt.errnum = errno;
+        return rt;
+    }
+
+    while (r < maxrows) {
+        const char *p, *end, *q;
+        int nfields;
+
+        rt = rs_getline(rsp);
+        if (rt.type == rt_start_longline || rt.type == rt_within_longline
+                || rt.type == rt_longline_ended)
+            continue;                           // skip long lines
+        if (rt.type != rt_full_line && rt.type != rt_full_line_without_eol)
+            break;
+
+        // Spans of fields 0 .. maxfield, as far as the line goes.
+        p = rt.line.begin;
+        end = rt.line.end + (rt.type == rt_full_line_without_eol);
+        for (nfields = 0; nfields <= maxfield; nfields++) {
+            q = memchr(p, fieldsep, end - p);
+            if (q == NULL)
+                q = end;
+            fields[nfields].begin = p;
+            fields[nfields].end = q;            // (exclusive, here)
+            if (q == end) {
+                nfields++;
+                break;
+            }
+            p = q + 1;
+        }
+
+        for (i = 0; i < ncols; i++) {
+            const RAWSCAN_COLUMN *c = &cols[i];
+            const char *fb, *fe;
+            bool ok = false;
+
+            if (c->field >= 0 && c->field < nfields) {
+                fb = fields[c->field].begin;
+                fe = fields[c->field].end;
+                if (fb < fe) {
+                    switch (c->type) {
+                    case rs_col_int64:
+                        ok = rawscan_parse_int64(fb, fe,
+                                                 (int64_t *)c->values + r);
+                        break;
+                    case rs_col_double:
+                        ok = rawscan_parse_double(fb, fe,
+                                                  (double *)c->values + r);
+                        break;
+                    case rs_col_time:
+                        ok = rawscan_parse_rfc3339(fb, fe - fb,
+                                        (int64_t *)c->values + r, false);
+                        break;
+                    }
+                }
+            }
+            if (!ok) {
+                if (c->type == rs_col_double)
+                    ((double *)c->values)[r] = NAN;
+                else
+                    ((int64_t *)c->values)[r] = 0;
+            }
+            if (c->valid != NULL)
+                c->valid[r] = ok;
+        }
+        r++;
+    }
+
+    free(fields);
+    *nrows = r;
+    return rt;
+}
+
+/*
+ * rs_getarrow(), rs_arrow_schema(): export batches of lines as Apache
+ * Arrow string arrays, through the Arrow C Data Interface.
+ *
+ * rs_getarrow(rsp, type, maxrows, maxbytes, out) reads up to maxrows
+ * lines from rsp, less their delimiterbytes, copying them once into
+ * the contiguous data buffer of an Arrow utf8 ("u"), large_utf8 ("U"),
+ * binary ("z") or large_binary ("Z") array, with an int32 (or, for the
+ * large types, int64) offsets buffer, and fills in *out.  The batch
+ * also ends before a line that would take the data past maxbytes
+ * (unless that line is the first, for which the buffer is enlarged):
+ * rs_peekline() looks at each line first, leaving that line for the
+ * next batch.  A long line, which rs_getline returns in chunks, is a
+ * null entry, with a validity bitmap, which is only allocated (and
+ * out->buffers[0] only non-NULL) if the batch holds one or more nulls.
+ * Returns the RAWSCAN_RESULT of the last line looked at, or the
+ * rt_eof, rt_err or rt_paused that ended the batch short.  A read
+ * error after some lines doesn't lose them: the batch of those lines
+ * is returned, with the result of its last line, and the error is
+ * returned by the next call, as rs_getline() returns it again.  So on
+ * rt_err no batch is returned: errnum is that of the read error,
+ * ENOMEM if the buffers couldn't be allocated, or EINVAL if maxrows is
+ * 0, and out->release is NULL.  Otherwise the consumer owns *out, and calls
+ * out->release(out) when done, per the C Data Interface.  Buffers are
+ * 64 byte aligned and padded, as Arrow recommends.  Lines are not
+ * checked for valid UTF-8; use the binary types if they may not be.
+ *
+ * rs_arrow_schema(type, name, out) fills in the matching ArrowSchema,
+ * for consumers, such as pyarrow's Array._import_from_c(), DuckDB or
+ * nanoarrow, that import an array along with its schema.  Returns 0,
+ * or -1 with errno ENOMEM.
+ *
+ * No Arrow library is needed: the two structs are declared in rawscan.h
+ * as the C Data Interface specification provides them.
+ */
+
+struct rawscan_arrow {
+    const void *buffers[3];     // validity bitmap, offsets, data
+};
+
+static void *rawscan_arrow_alloc(size_t n)
+{
+    void *p;
+
+    n = n == 0 ? 64 : (n + 63) & ~(size_t)63;
+    if ((errno = posix_memalign(&p, 64, n)) != 0)
+        return NULL;
+    return p;
+}
+
+static void rawscan_arrow_release(struct ArrowArray *array)
+{
+    struct rawscan_arrow *ap = array->private_data;
+    int i;
+
+    for (i = 0; i < 3; i++)
+        free((void *)ap->buffers[i]);
+    free(ap);
+    array->release = NULL;
+}
+
+static void rawscan_arrow_set_offset(void *offsets, bool large, size_t i,
+                                     size_t off)
+{
+    if (large)
+        ((int64_t *)offsets)[i] = (int64_t)off;
+    else
+        ((int32_t *)offsets)[i] = (int32_t)off;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_getarrow(RAWSCAN *rsp,
+        enum rs_arrow_type type, size_t maxrows, size_t maxbytes,
+        struct ArrowArray *out)
+{
+    bool large = type == rs_arrow_large_utf8 || type == rs_arrow_large_binary;
+    struct rawscan_arrow *ap = NULL;
+    RAWSCAN_RESULT rt, last;
+    uint8_t *valid = NULL;
+    char *data = NULL;
+    void *offsets;
+    size_t r = 0, used = 0, cap = 0, nulls = 0;
+
+    memset(out, 0, sizeof(*out));
+    memset(&rt, 0, sizeof(rt));
+    if (maxrows == 0) {                         // no line to return
+        rt.type = rt_err;
+        rt.errnum = EINVAL;
+        return rt;
+    }
+    if (!large && maxbytes > INT32_MAX)
+        maxbytes = INT32_MAX;
+    if ((ap = calloc(1, sizeof(*ap))) == NULL)
+        goto nomem;
+    if ((offsets = rawscan_arrow_alloc((maxrows + 1) * (large ? 8 : 4))) == NULL)
+        goto nomem;
+    ap->buffers[1] = offsets;
+    rawscan_arrow_set_offset(offsets, large, 0, 0);
+
+    while (r < maxrows) {
+        size_t len;
+
+        rt = rawscan_peekline(rsp, true);       // prior line copied out
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+            len = rt.line.end - rt.line.begin + (rt.type == rt_full_line_without_eol);
+            if (data == NULL) {
+                cap = len > maxbytes ? len : maxbytes;
+                if (!large && cap > INT32_MAX)
+                    goto nomem;
+                if ((data = rawscan_arrow_alloc(cap)) == NULL)
+                    goto nomem;
+                ap->buffers[2] = data;
+            } else if (used + len > cap) {
+                goto done;                      // leave line for next batch
+            }
+            memcpy(data + used, rt.line.begin, len);
+            used += len;
+            (void)rs_getline(rsp);
+            break;
+
+        case rt_start_longline:                 // a null entry
+            if (valid == NULL) {
+                if ((valid = rawscan_arrow_alloc((maxrows + 7) / 8)) == NULL)
+                    goto nomem;
+                memset(valid, 0xFF, (maxrows + 7) / 8);
+                ap->buffers[0] = valid;
+            }
+            valid[r / 8] &= ~(1u << (r % 8));
+            nulls++;
+            do {
+                rt = rs_getline(rsp);           // skip its chunks
+            } while (rt.type == rt_start_longline || rt.type == rt_within_longline);
+            if (rt.type == rt_err) {            // not a whole null: drop it
+                valid[r / 8] |= 1u << (r % 8);
+                nulls--;
+                continue;
+            }
+            break;
+
+        case rt_within_longline:                // rest of a long line, paused
+        case rt_longline_ended:                 // in the last batch's null
+            do {
+                rt = rs_getline(rsp);
+            } while (rt.type == rt_within_longline);
+            continue;
+
+        case rt_err:                            // batch so far, then error
+            if (r == 0)
+                goto fail;
+            rt = last;
+            goto done;
+
+        default:                                // paused or eof
+            goto done;
+        }
+        rawscan_arrow_set_offset(offsets, large, ++r, used);
+        last = rt;
+    }
+
+done:
+    if (data == NULL && (ap->buffers[2] = data = rawscan_arrow_alloc(0)) == NULL)
+        goto nomem;
+    out->length = r;
+    out->null_count = nulls;
+    out->offset = 0;
+    out->n_buffers = 3;
+    out->n_children = 0;
+    out->buffers = ap->buffers;
+    out->children = NULL;
+    out->dictionary = NULL;
+    out->release = rawscan_arrow_release;
+    out->private_data = ap;
+    return rt;
+
+nomem:
+    rt.type = rt_err;
+    rt.errnum = ENOMEM;
+fail:
+    if (ap != NULL) {
+        free((void *)ap->buffers[0]);
+        free((void *)ap->buffers[1]);
+        free((void *)ap->buffers[2]);
+        free(ap);
+    }
+    memset(out, 0, sizeof(*out));
+    return rt;
+}
+
+static void rawscan_arrow_schema_release(struct ArrowSchema *schema)
+{
+    free(schema->private_data);
+    schema->release = NULL;
+}
+
+__unused__ func_static int rs_arrow_schema(enum rs_arrow_type type,
+        const char *name, struct ArrowSchema *out)
+{
+    static const char *const formats[] = { "u", "U", "z", "Z" };
+    char *copy = NULL;
+
+    memset(out, 0, sizeof(*out));
+    if (name != NULL) {
+        size_t n = strlen(name) + 1;
+
+        if ((copy = malloc(n)) == NULL)
+            return -1;
+        memcpy(copy, name, n);
+    }
+    out->format = formats[type];
+    out->name = copy;
+    out->metadata = NULL;
+    out->flags = ARROW_FLAG_NULLABLE;
+    out->n_children = 0;
+    out->children = NULL;
+    out->dictionary = NULL;
+    out->release = rawscan_arrow_schema_release;
+    out->private_data = copy;
+    return 0;
+}
+
+/*
+ * rs_set_transform(): rewrite input bytes in place, as read, before
+ * they are scanned for lines.
+ *
+ * rs_set_transform(rsp, map) has each byte b read into rsp's buffer
+ * from now on replaced by map[b], as "tr" would, or, if map is NULL,
+ * stops doing so.  Bytes already read, but not yet returned, are
+ * rewritten too, so a stream from rs_bulk_next() can be given a map.
+ * Because lines are found after the rewrite, a map can also change
+ * which bytes end lines, but such a map should be set before the
+ * first rs_getline().  Returns 0, or -1 with errno ENOMEM.
+ *
+ * Once a map is set, bytes read but not yet returned have already
+ * been through it, and rewriting them with another map would apply
+ * both.  So while there are any, the map can't be changed (or
+ * dropped): passing the same map again does nothing, and any other
+ * fails with errno EBUSY.  This is how a stream from rs_bulk_next(),
+ * which keeps the map given it for the files read into it after,
+ * can be given the same map for each file.  rs_reopen() discards
+ * the buffered bytes, so the map can be changed after it.
+ *
+ * rs_transform_map(map, flags) sets map to the identity, then applies
+ * the RS_XFORM_* flags: ASCII lowercase or uppercase, and NUL to
+ * space.  Further entries can then be changed, tr style, before
+ * passing the map to rs_set_transform().
+ *
+ * The map is broken into runs of consecutive bytes that all change by
+ * the same amount: 'A' .. 'Z' up 32 for lowercase, NUL up 32 to space,
+ * or one run per byte for most tr maps.  Up to RAWSCAN_XFORM_RUNS runs
+ * are applied 32 or 16 bytes at a time, with AVX2 or SSE2: a range
+ * compare per run, selecting its delta to add to the bytes in range.
+ * Maps with more runs than that fall back to a table lookup per byte.
+ * So case-insensitive matching and normalization cost a pass over the
+ * new data at memory bandwidth, in place, with no per-line copy.
+ */
+
+#define RAWSCAN_XFORM_RUNS 8
+
+struct rawscan_xform {
+    unsigned char map[256];
+    int nruns;                  // number of runs, or -1 to use map
+    unsigned char lo[RAWSCAN_XFORM_RUNS];     // first byte in run
+    unsigned char span[RAWSCAN_XFORM_RUNS];   // last byte - first byte
+    unsigned char delta[RAWSCAN_XFORM_RUNS];  // added (mod 256) to each
+};
+
+static void rawscan_xform_apply(const struct rawscan_xform *xf, char *p,
+                                size_t n)
+{
+    char *end = p + n;
+    int i;
+
+#if defined(__AVX2__)
+    if (xf->nruns > 0) {
+        __m256i lo[RAWSCAN_XFORM_RUNS], span[RAWSCAN_XFORM_RUNS],
+                delta[RAWSCAN_XFORM_RUNS];
+
+        for (i = 0; i < xf->nruns; i++) {
+            lo[i] = _mm256_set1_epi8((char)xf->lo[i]);
+            span[i] = _mm256_set1_epi8((char)xf->span[i]);
+            delta[i] = _mm256_set1_epi8((char)xf->delta[i]);
+        }
+        for (; end - p >= 32; p += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)p);
+            __m256i add = _mm256_setzero_si256();
+
+            for (i = 0; i < xf->nruns; i++) {
+                __m256i d = _mm256_sub_epi8(v, lo[i]);
+                __m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(d, span[i]), d);
+
+                add = _mm256_or_si256(add, _mm256_and_si256(in, delta[i]));
+            }
+            _mm256_storeu_si256((__m256i *)p, _mm256_add_epi8(v, add));
+        }
+    }
+#elif defined(__SSE2__)
+    if (xf->nruns > 0) {
+        __m128i lo[RAWSCAN_XFORM_RUNS], span[RAWSCAN_XFORM_RUNS],
+                delta[RAWSCAN_XFORM_RUNS];
+
+        for (i = 0; i < xf->nruns; i++) {
+            lo[i] = _mm_set1_epi8((char)xf->lo[i]);
+            span[i] = _mm_set1_epi8((char)xf->span[i]);
+            delta[i] = _mm_set1_epi8((char)xf->delta[i]);
+        }
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)p);
+            __m128i add = _mm_setzero_si128();
+
+            for (i = 0; i < xf->nruns; i++) {
+                __m128i d = _mm_sub_epi8(v, lo[i]);
+                __m128i in = _mm_cmpeq_epi8(_mm_min_epu8(d, span[i]), d);
+
+                add = _mm_or_si128(add, _mm_and_si128(in, delta[i]));
+            }
+            _mm_storeu_si128((__m128i *)p, _mm_add_epi8(v, add));
+        }
+    }
+#endif
+    (void)i;
+    for (; p < end; p++)
+        *p = (char)xf->map[(unsigned char)*p];
+}
+
+__unused__ func_static void rs_transform_map(unsigned char map[256],
+                                             unsigned flags)
+{
+    int b;
+
+    for (b = 0; b < 256; b++)
+        map[b] = (unsigned char)b;
+    if (flags & RS_XFORM_TOLOWER)
+        for (b = 'A'; b <= 'Z'; b++)
+            map[b] = (unsigned char)(b - 'A' + 'a');
+    if (flags & RS_XFORM_TOUPPER)
+        for (b = 'a'; b <= 'z'; b++)
+            map[b] = (unsigned char)(b - 'a' + 'A');
+    if (flags & RS_XFORM_NUL_TO_SPACE)
+        map[0] = ' ';
+}
+
+__unused__ func_static int rs_set_transform(RAWSCAN *rsp,
+                                            const unsigned char *map)
+{
+    struct rawscan_xform *xf;
+    int b;
+
+    if (rsp->xform != NULL && rsp->p < rsp->q) {    // mid-stream
+        if (map != NULL && memcmp(rsp->xform->map, map, 256) == 0)
+            return 0;
+        errno = EBUSY;
+        return -1;
+    }
+    free(rsp->xform);
+    rsp->xform = NULL;
+    if (map == NULL)
+        return 0;
+    if ((xf = malloc(sizeof(*xf))) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(xf->map, map, 256);
+
+    // Split changed bytes into runs of consecutive bytes, same delta.
+    xf->nruns = 0;
+    for (b = 0; b < 256; b++) {
+        unsigned char delta = (unsigned char)(map[b] - b);
+        int first = b;
+
+        if (delta == 0)
+            continue;
+        while (b + 1 < 256 && (unsigned char)(map[b + 1] - (b + 1)) == delta)
+            b++;
+        if (xf->nruns == RAWSCAN_XFORM_RUNS) {
+            xf->nruns = -1;                     // too many: use map
+            break;
+        }
+        xf->lo[xf->nruns] = (unsigned char)first;
+        xf->span[xf->nruns] = (unsigned char)(b - first);
+        xf->delta[xf->nruns] = delta;
+        xf->nruns++;
+    }
+    if (xf->nruns == 0) {
+        free(xf);                               // identity: nothing to do
+        return 0;
+    }
+    rsp->xform = xf;
+
+    // Rewrite what's read but not yet returned.
+    if (rsp->p < rsp->q)
+        rawscan_xform_apply(xf, (char *)rsp->p, rsp->q - rsp->p);
+    return 0;
+}
+
+/*
+ * rs_filter_open(), rs_getline_filtered(): return only the lines
+ * holding (or starting with) a literal, optionally ignoring ASCII case.
+ *
+ * rs_filter_open(literal, len, flags) prepares a filter for the len
+ * byte literal, ignoring ASCII case if RS_FILTER_NOCASE is set, and
+ * matching only at the start of lines if RS_FILTER_PREFIX is set.
+ * Returns NULL, with errno set, on failure.  One filter can be used
+ * by any number of streams; rs_filter_close() frees it.
+ *
+ * rs_getline_filtered(rsp, fp, match) returns the next line from rsp
+ * that matches fp, as rs_getline() would, setting *match to the span
+ * of its first match, or returns rt_eof, rt_err or rt_paused.  The
+ * buffer isn't changed: lines and spans come back in their original
+ * case.  A long line matches, and all its chunks (then rt_longline_ended)
+ * are returned, if its first chunk matches; *match is NULL for the later
+ * chunks.
+ *
+ * Rather than search each line in turn, a substring filter searches
+ * all the complete lines in the buffer at once, from the current line
+ * on, and skips the lines before the first match found without looking
+ * at them again.  Two bytes of the literal, chosen to be rare in
+ * typical text, are compared, in both cases if RS_FILTER_NOCASE, with
+ * 32 or 16 positions at a time by AVX2 or SSE2, and only the positions
+ * where both agree are checked in full.  (A literal holding the stream's
+ * delimiterbyte, such as "error\n" to match line endings, is searched
+ * for a line at a time.)
+ */
+
+struct RAWSCAN_FILTER {
+    unsigned char fold[256];        // byte to compare: lowercase if NOCASE
+    size_t len;
+    size_t i1, i2;                  // rare byte offsets in literal
+    unsigned char c1[2], c2[2];     // their two cases (same if none)
+    bool prefix;
+    unsigned char lit[];            // literal, folded
+};
+
+// Rough rarity in text of byte c: higher is rarer.
+
+static int rawscan_filter_rarity(unsigned char c)
+{
+    static const char freq[] = "etaoinsrhldcumfpgwybvkxjqz";
+    const char *f;
+
+    if (c == ' ' || c == '\t')
+        return 0;
+    if (c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+    if (c >= 'a' && c <= 'z' && (f = strchr(freq, c)) != NULL)
+        return 10 + (int)(f - freq);
+    if (c >= '0' && c <= '9')
+        return 30;
+    return c < 0x80 ? 40 : 45;
+}
+
+__unused__ func_static RAWSCAN_FILTER *rs_filter_open(const char *literal,
+        size_t len, unsigned flags)
+{
+    RAWSCAN_FILTER *fp;
+    size_t i;
+    int c, r1 = -1, r2 = -1;
+
+    if (len == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((fp = malloc(sizeof(*fp) + len)) == NULL)
+        return NULL;
+    for (c = 0; c < 256; c++)
+        fp->fold[c] = (flags & RS_FILTER_NOCASE) && c >= 'A' && c <= 'Z' ?
+                                (unsigned char)(c - 'A' + 'a') : (unsigned char)c;
+    fp->len = len;
+    fp->prefix = (flags & RS_FILTER_PREFIX) != 0;
+    fp->i1 = fp->i2 = 0;
+    for (i = 0; i < len; i++) {
+        int r = rawscan_filter_rarity((unsigned char)literal[i]);
+
+        fp->lit[i] = fp->fold[(unsigned char)literal[i]];
+        if (r > r1) {
+            fp->i2 = fp->i1;
+            r2 = r1;
+            fp->i1 = i;
+            r1 = r;
+        } else if (r > r2) {
+            fp->i2 = i;
+            r2 = r;
+        }
+    }
+    if (len == 1)
+        fp->i2 = 0;
+    fp->c1[0] = fp->c1[1] = fp->lit[fp->i1];
+    fp->c2[0] = fp->c2[1] = fp->lit[fp->i2];
+    if ((flags & RS_FILTER_NOCASE) && fp->c1[0] >= 'a' && fp->c1[0] <= 'z')
+        fp->c1[1] = fp->c1[0] - 'a' + 'A';
+    if ((flags & RS_FILTER_NOCASE) && fp->c2[0] >= 'a' && fp->c2[0] <= 'z')
+        fp->c2[1] = fp->c2[0] - 'a' + 'A';
+    return fp;
+}
+
+__unused__ func_static void rs_filter_close(RAWSCAN_FILTER *fp)
+{
+    free(fp);
+}
+
+static inline bool rawscan_filter_verify(const RAWSCAN_FILTER *fp,
+                                         const char *s)
+{
+    size_t j;
+
+    for (j = 0; j < fp->len; j++)
+        if (fp->fold[(unsigned char)s[j]] != fp->lit[j])
+            return false;
+    return true;
+}
+
+// First match of fp's literal within [p, end), or NULL.
+
+static const char *rawscan_filter_find(const RAWSCAN_FILTER *fp,
+                                       const char *p, const char *end)
+{
+    const char *last;               // last place a match could start
+
+    if ((size_t)(end - p) < fp->len)
+        return NULL;
+    last = end - fp->len;
+
+#if defined(__AVX2__)
+    {
+        const __m256i a0 = _mm256_set1_epi8((char)fp->c1[0]),
+                      a1 = _mm256_set1_epi8((char)fp->c1[1]),
+                      b0 = _mm256_set1_epi8((char)fp->c2[0]),
+                      b1 = _mm256_set1_epi8((char)fp->c2[1]);
+
+        for (; last - p >= 31; p += 32) {
+            __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + fp->i1));
+            __m256i v2 = _mm256_loadu_si256((const __m256i *)(p + fp->i2));
+            uint32_t m = _mm256_movemask_epi8(_mm256_and_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v1, a0), _mm256_cmpeq_epi8(v1, a1)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v2, b0), _mm256_cmpeq_epi8(v2, b1))));
+
+            for (; m != 0; m &= m - 1)
+                if (rawscan_filter_verify(fp, p + __builtin_ctz(m)))
+                    return p + __builtin_ctz(m);
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128i a0 = _mm_set1_epi8((char)fp->c1[0]),
+                      a1 = _mm_set1_epi8((char)fp->c1[1]),
+                      b0 = _mm_set1_epi8((char)fp->c2[0]),
+                      b1 = _mm_set1_epi8((char)fp->c2[1]);
+
+        for (; last - p >= 15; p += 16) {
+            __m128i v1 = _mm_loadu_si128((const __m128i *)(p + fp->i1));
+            __m128i v2 = _mm_loadu_si128((const __m128i *)(p + fp->i2));
+            unsigned m = _mm_movemask_epi8(_mm_and_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v1, a0), _mm_cmpeq_epi8(v1, a1)),
+                    _mm_or_si128(_mm_cmpeq_epi8(v2, b0), _mm_cmpeq_epi8(v2, b1))));
+
+            for (; m != 0; m &= m - 1)
+                if (rawscan_filter_verify(fp, p + __builtin_ctz(m)))
+                    return p + __builtin_ctz(m);
+        }
+    }
+#endif
+    for (; p <= last; p++)
+        if (rawscan_filter_verify(fp, p))
+            return p;
+    return NULL;
+}
+
+// Match of fp in line [b, e), e just past its delimiterbyte, or NULL.
+
+static const char *rawscan_filter_line(RAWSCAN *rsp, const RAWSCAN_FILTER *fp,
+                                       const char *b, const char *e)
+{
+    const char *m;
+
+    if (fp->prefix)
+        return (size_t)(e - b) >= fp->len && rawscan_filter_verify(fp, b) ?
+                                                                b : NULL;
+    if (memchr(fp->lit, fp->fold[(unsigned char)rsp->delimiterbyte],
+               fp->len) != NULL)
+        return rawscan_filter_find(fp, b, e);   // might span lines
+
+    // Search all complete lines from here, unless already done.
+    if (rsp->filt.fp != fp || rsp->filt.nfills != rsp->nfills
+                                                || b >= rsp->filt.end) {
+        const char *ld = memrchr(b, rsp->delimiterbyte, rsp->q - b);
+
+        rsp->filt.fp = fp;
+        rsp->filt.nfills = rsp->nfills;
+        rsp->filt.end = ld != NULL && ld + 1 > e ? ld + 1 : e;
+        rsp->filt.match = rawscan_filter_find(fp, b, rsp->filt.end);
+    }
+    if (rsp->filt.match == NULL || rsp->filt.match >= e)
+        return NULL;                            // no match on this line
+    m = rsp->filt.match;
+    rsp->filt.end = e;                          // next line: search again
+    return m;
+}
+
+__unused__ func_static RAWSCAN_RESULT rs_getline_filtered(RAWSCAN *rsp,
+        const RAWSCAN_FILTER *fp, RAWSCAN_SPAN *match)
+{
+    RAWSCAN_RESULT rt;
+    const char *m;
+
+    for (;;) {
+        rt = rs_getline(rsp);
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+        case rt_start_longline:
+            m = rawscan_filter_line(rsp, fp, rt.line.begin, rt.line.end + 1);
+            if (rt.type == rt_start_longline)
+                rsp->filt.inlong = m != NULL;
+            if (m == NULL)
+                continue;
+            match->begin = m;
+            match->end = m + fp->len - 1;
+            return rt;
+
+        case rt_within_longline:
+        case rt_longline_ended:
+            if (!rsp->filt.inlong)
+                continue;
+            if (rt.type == rt_longline_ended)
+                rsp->filt.inlong = false;
+            match->begin = match->end = NULL;
+            return rt;
+
+        default:                                // paused, eof or error
+            return rt;
+        }
+    }
+}
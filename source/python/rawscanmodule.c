@@ -0,0 +1,605 @@
+/*
+ * rawscan Python extension module.
+ *
+ * Wraps rs_open() and rs_getline(), for Python 3:
+ *
+ *   import rawscan
+ *   with rawscan.Scanner(sys.stdin.buffer) as sc:
+ *       for line in sc:                        # one bytes per line
+ *           ...
+ *
+ * and, crucially, returns whole batches of lines, so that Python code
+ * can work on millions of lines with vectorized NumPy operations
+ * rather than one bytes object per line:
+ *
+ *   while (batch := sc.batch()) is not None:
+ *       data, offsets, valid = batch
+ *       starts, ends = offsets[:-1], offsets[1:]
+ *       line_i = data[starts[i]:ends[i]]
+ *
+ * data is a read-only memoryview of the batch's lines, less their
+ * delimiterbytes, end to end, and offsets is a NumPy int64 array of
+ * len(lines) + 1 byte offsets into data (or, if NumPy can't be
+ * imported, a read-only memoryview of format 'q', which
+ * numpy.frombuffer(offsets, numpy.int64) takes as is).  Both share
+ * one buffer, filled by rs_getarrow() with one copy of each line out
+ * of the scan buffer, and freed once neither is referenced.  This is
+ * the Arrow large_binary layout, in which a long line, longer than
+ * the scan buffer, is a null: empty, and marked missing in valid.
+ * valid is None if the batch has no such lines, else a NumPy bool
+ * array, True for each line present (or, without NumPy, the Arrow
+ * validity bitmap itself, as a read-only memoryview of bytes, bit
+ * i % 8 of byte i / 8 set if line i is present).
+ *
+ * Each Scanner has a lock, as io.BufferedReader has, held while it
+ * scans, with the GIL released, so that threads sharing a Scanner
+ * take turns rather than corrupt its stream.
+ *
+ * The rawscan input buffers can never be freed (see rs_close), so the
+ * streams of closed Scanners are kept, and reused by rs_reopen() for
+ * later Scanners of the same buffer size and delimiter.
+ *
+ * Build with:  cd source/python && python3 setup.py build_ext --inplace
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rawscan.h>
+
+// Streams of closed Scanners, for reuse.
+
+struct pool_entry {
+    struct pool_entry *next;
+    RAWSCAN *rsp;
+    size_t bufsz;
+    char delim;
+};
+
+static struct pool_entry *pool;
+
+static RAWSCAN *pool_get(int fd, size_t bufsz, char delim)
+{
+    struct pool_entry **pp, *p;
+    RAWSCAN *rsp;
+
+    for (pp = &pool; (p = *pp) != NULL; pp = &p->next) {
+        if (p->bufsz == bufsz && p->delim == delim) {
+            *pp = p->next;
+            rsp = p->rsp;
+            free(p);
+            rs_reopen(rsp, fd);
+            return rsp;
+        }
+    }
+    return rs_open(fd, bufsz, delim);
+}
+
+static void pool_put(RAWSCAN *rsp, size_t bufsz, char delim)
+{
+    struct pool_entry *p = malloc(sizeof(*p));
+
+    rs_close(rsp);
+    if (p == NULL)
+        return;                     // leaks the stream; can't be helped
+    p->rsp = rsp;
+    p->bufsz = bufsz;
+    p->delim = delim;
+    p->next = pool;
+    pool = p;
+}
+
+/*
+ * _Buffer: read-only buffer protocol view of one buffer of a batch's
+ * ArrowArray, which is owned by a capsule shared by the batch's views.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *owner;                // capsule releasing the ArrowArray
+    void *buf;
+    Py_ssize_t len;                 // in bytes
+    Py_ssize_t itemsize;
+    Py_ssize_t shape;               // len / itemsize
+    const char *format;
+} BufferObject;
+
+static void Buffer_dealloc(BufferObject *self)
+{
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int Buffer_getbuffer(BufferObject *self, Py_buffer *view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "rawscan batch is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->buf;
+    view->len = self->len;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs Buffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Buffer_getbuffer,
+};
+
+static PyTypeObject BufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "rawscan._Buffer",
+    .tp_basicsize = sizeof(BufferObject),
+    .tp_dealloc = (destructor)Buffer_dealloc,
+    .tp_as_buffer = &Buffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Read-only buffer of a rawscan batch",
+};
+
+static void batch_capsule_release(PyObject *capsule)
+{
+    struct ArrowArray *array = PyCapsule_GetPointer(capsule, NULL);
+
+    if (array->release != NULL)
+        array->release(array);
+    free(array);
+}
+
+// memoryview of buf, kept alive by owner.
+
+static PyObject *batch_view(PyObject *owner, void *buf, Py_ssize_t len,
+                            Py_ssize_t itemsize, const char *format)
+{
+    BufferObject *b = PyObject_New(BufferObject, &BufferType);
+    PyObject *view;
+
+    if (b == NULL)
+        return NULL;
+    Py_INCREF(owner);
+    b->owner = owner;
+    b->buf = buf;
+    b->len = len;
+    b->itemsize = itemsize;
+    b->shape = len / itemsize;
+    b->format = format;
+    view = PyMemoryView_FromObject((PyObject *)b);
+    Py_DECREF(b);
+    return view;
+}
+
+// numpy.frombuffer (and co.), or NULL if NumPy isn't there; looked up once.
+
+static PyObject *np_frombuffer, *np_int64, *np_unpackbits, *np_bool;
+static int np_looked;
+
+static void numpy_lookup(void)
+{
+    PyObject *np;
+
+    np_looked = 1;
+    if ((np = PyImport_ImportModule("numpy")) == NULL) {
+        PyErr_Clear();
+        return;
+    }
+    np_frombuffer = PyObject_GetAttrString(np, "frombuffer");
+    np_int64 = PyObject_GetAttrString(np, "int64");
+    np_unpackbits = PyObject_GetAttrString(np, "unpackbits");
+    np_bool = PyObject_GetAttrString(np, "bool_");
+    Py_DECREF(np);
+    if (np_frombuffer == NULL || np_int64 == NULL ||
+            np_unpackbits == NULL || np_bool == NULL) {
+        PyErr_Clear();
+        Py_CLEAR(np_frombuffer);
+        Py_CLEAR(np_int64);
+        Py_CLEAR(np_unpackbits);
+        Py_CLEAR(np_bool);
+    }
+}
+
+/*
+ * Scanner
+ */
+
+typedef struct {
+    PyObject_HEAD
+    RAWSCAN *rsp;                   // NULL once closed
+    size_t bufsz;
+    char delim;
+    PyObject *file;                 // keeps a file object open, if given one
+    PyThread_type_lock lock;        // held while using rsp
+    unsigned long owner;            // thread holding lock, if any
+} ScannerObject;
+
+// Take self's lock, waiting without the GIL if another thread has it.
+// Fails, with RuntimeError, on a reentrant call from the thread that
+// has it (as from a finalizer run while it scans).
+
+static int Scanner_lock(ScannerObject *self)
+{
+    if (self->lock == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Scanner not initialized");
+        return -1;
+    }
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        if (self->owner == PyThread_get_thread_ident()) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "reentrant call inside Scanner");
+            return -1;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+    self->owner = PyThread_get_thread_ident();
+    return 0;
+}
+
+static void Scanner_unlock(ScannerObject *self)
+{
+    self->owner = 0;
+    PyThread_release_lock(self->lock);
+}
+
+static int Scanner_init(ScannerObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "file", "bufsize", "delimiter", NULL };
+    PyObject *file;
+    Py_ssize_t bufsz = 1 << 20;
+    const char *delim = "\n";
+    Py_ssize_t delimlen = 1;
+    int fd;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ny#", kwlist,
+                                     &file, &bufsz, &delim, &delimlen))
+        return -1;
+    if (delimlen != 1) {
+        PyErr_SetString(PyExc_ValueError, "delimiter must be one byte");
+        return -1;
+    }
+    if (bufsz < 2) {
+        PyErr_SetString(PyExc_ValueError, "bufsize too small");
+        return -1;
+    }
+    if ((fd = PyObject_AsFileDescriptor(file)) < 0)
+        return -1;
+    if (self->lock == NULL && (self->lock = PyThread_allocate_lock()) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (Scanner_lock(self) < 0)
+        return -1;
+    if (self->rsp != NULL) {
+        pool_put(self->rsp, self->bufsz, self->delim);
+        self->rsp = NULL;
+    }
+    if ((self->rsp = pool_get(fd, bufsz, delim[0])) == NULL) {
+        Scanner_unlock(self);
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->bufsz = bufsz;
+    self->delim = delim[0];
+    Scanner_unlock(self);
+    Py_INCREF(file);
+    Py_XSETREF(self->file, file);
+    return 0;
+}
+
+// Caller holds self's lock, or is the last reference to self.
+
+static void Scanner_release(ScannerObject *self)
+{
+    if (self->rsp != NULL) {
+        pool_put(self->rsp, self->bufsz, self->delim);
+        self->rsp = NULL;
+    }
+    Py_CLEAR(self->file);
+}
+
+static void Scanner_dealloc(ScannerObject *self)
+{
+    Scanner_release(self);
+    if (self->lock != NULL)
+        PyThread_free_lock(self->lock);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *Scanner_locked_release(ScannerObject *self)
+{
+    if (self->lock != NULL) {
+        if (Scanner_lock(self) < 0)
+            return NULL;
+        Scanner_release(self);
+        Scanner_unlock(self);
+    }
+    Py_RETURN_NONE;
+}
+
+static int Scanner_check_open(ScannerObject *self)
+{
+    if (self->rsp == NULL) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed Scanner");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *Scanner_close(ScannerObject *self, PyObject *unused)
+{
+    (void)unused;
+    return Scanner_locked_release(self);
+}
+
+static PyObject *Scanner_enter(ScannerObject *self, PyObject *unused)
+{
+    (void)unused;
+    if (Scanner_check_open(self) < 0)
+        return NULL;
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *Scanner_exit(ScannerObject *self, PyObject *args)
+{
+    PyObject *none;
+
+    (void)args;
+    if ((none = Scanner_locked_release(self)) == NULL)
+        return NULL;
+    Py_DECREF(none);
+    Py_RETURN_FALSE;
+}
+
+// Next line, with its delimiterbyte, as bytes; b"" at end of input.
+// Caller holds self's lock.
+
+static PyObject *Scanner_readline_locked(ScannerObject *self)
+{
+    RAWSCAN_RESULT rt;
+    PyObject *line = NULL;
+    Py_ssize_t len = 0;
+
+    if (Scanner_check_open(self) < 0)
+        return NULL;
+    for (;;) {
+        Py_ssize_t n;
+
+        Py_BEGIN_ALLOW_THREADS
+        rt = rs_getline(self->rsp);
+        Py_END_ALLOW_THREADS
+
+        switch (rt.type) {
+        case rt_full_line:
+        case rt_full_line_without_eol:
+            return PyBytes_FromStringAndSize(rt.line.begin,
+                                             rt.line.end - rt.line.begin + 1);
+
+        case rt_longline_ended:                 // (has no data itself)
+            if (line != NULL)
+                return line;
+            break;                              // (ended a line cut by pause)
+
+        case rt_start_longline:                 // gather the chunks
+        case rt_within_longline:
+            n = rt.line.end - rt.line.begin + 1;
+            if (line == NULL) {
+                if ((line = PyBytes_FromStringAndSize(NULL, n)) == NULL)
+                    return NULL;
+            } else if (_PyBytes_Resize(&line, len + n) < 0) {
+                return NULL;
+            }
+            memcpy(PyBytes_AS_STRING(line) + len, rt.line.begin, n);
+            len += n;
+            break;
+
+        case rt_err:
+            Py_XDECREF(line);
+            errno = rt.errnum;
+            return PyErr_SetFromErrno(PyExc_OSError);
+
+        default:                                // eof (or paused)
+            return line != NULL ? line : PyBytes_FromStringAndSize(NULL, 0);
+        }
+    }
+}
+
+static PyObject *Scanner_readline(ScannerObject *self, PyObject *unused)
+{
+    PyObject *line;
+
+    (void)unused;
+    if (Scanner_lock(self) < 0)
+        return NULL;
+    line = Scanner_readline_locked(self);
+    Scanner_unlock(self);
+    return line;
+}
+
+static PyObject *Scanner_iternext(ScannerObject *self)
+{
+    PyObject *line = Scanner_readline(self, NULL);
+
+    if (line != NULL && PyBytes_GET_SIZE(line) == 0) {
+        Py_DECREF(line);
+        return NULL;                            // StopIteration
+    }
+    return line;
+}
+
+// (data, offsets, valid) of up to maxrows lines and about maxbytes;
+// None at eof.
+
+static PyObject *Scanner_batch(ScannerObject *self, PyObject *args,
+                               PyObject *kwds)
+{
+    static char *kwlist[] = { "maxrows", "maxbytes", NULL };
+    Py_ssize_t maxrows = 65536, maxbytes = 1 << 24;
+    struct ArrowArray *array;
+    RAWSCAN_RESULT rt;
+    PyObject *capsule, *data = NULL, *offsets = NULL, *valid = NULL;
+    PyObject *result = NULL;
+    const int64_t *offs;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|nn", kwlist,
+                                     &maxrows, &maxbytes))
+        return NULL;
+    if (maxrows < 1 || maxbytes < 1) {
+        PyErr_SetString(PyExc_ValueError, "maxrows and maxbytes must be > 0");
+        return NULL;
+    }
+    if (Scanner_lock(self) < 0)
+        return NULL;
+    if (Scanner_check_open(self) < 0) {
+        Scanner_unlock(self);
+        return NULL;
+    }
+    if ((array = malloc(sizeof(*array))) == NULL) {
+        Scanner_unlock(self);
+        return PyErr_NoMemory();
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rt = rs_getarrow(self->rsp, rs_arrow_large_binary, maxrows, maxbytes, array);
+    Py_END_ALLOW_THREADS
+    Scanner_unlock(self);
+
+    if (rt.type == rt_err) {                    // (no batch: lines read
+        free(array);                            // before it came back first)
+        errno = rt.errnum;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    if (array->length == 0) {
+        array->release(array);
+        free(array);
+        Py_RETURN_NONE;
+    }
+    if ((capsule = PyCapsule_New(array, NULL, batch_capsule_release)) == NULL) {
+        array->release(array);
+        free(array);
+        return NULL;
+    }
+
+    offs = array->buffers[1];
+    data = batch_view(capsule, (void *)array->buffers[2],
+                      offs[array->length], 1, "B");
+    offsets = batch_view(capsule, (void *)offs,
+                         (array->length + 1) * sizeof(int64_t),
+                         sizeof(int64_t), "q");
+    if (array->buffers[0] == NULL) {           // no nulls
+        Py_INCREF(Py_None);
+        valid = Py_None;
+    } else {
+        valid = batch_view(capsule, (void *)array->buffers[0],
+                           (array->length + 7) / 8, 1, "B");
+    }
+    if (data == NULL || offsets == NULL || valid == NULL)
+        goto out;
+
+    if (!np_looked)
+        numpy_lookup();
+    if (np_frombuffer != NULL) {
+        PyObject *arr = PyObject_CallFunctionObjArgs(np_frombuffer, offsets,
+                                                     np_int64, NULL);
+        if (arr == NULL)
+            goto out;
+        Py_SETREF(offsets, arr);
+        if (valid != Py_None) {                 // bitmap -> one bool per line
+            PyObject *bits = PyObject_CallFunction(np_frombuffer, "Os",
+                                                   valid, "u1");
+            if (bits == NULL)
+                goto out;
+            arr = PyObject_CallFunction(np_unpackbits, "Onns", bits,
+                                        (Py_ssize_t)-1,
+                                        (Py_ssize_t)array->length, "little");
+            Py_DECREF(bits);
+            if (arr == NULL)
+                goto out;
+            Py_SETREF(valid, PyObject_CallMethod(arr, "astype", "O", np_bool));
+            Py_DECREF(arr);
+            if (valid == NULL)
+                goto out;
+        }
+    }
+    result = PyTuple_Pack(3, data, offsets, valid);
+
+out:
+    Py_XDECREF(data);
+    Py_XDECREF(offsets);
+    Py_XDECREF(valid);
+    Py_DECREF(capsule);
+    return result;
+}
+
+static PyMethodDef Scanner_methods[] = {
+    { "readline", (PyCFunction)Scanner_readline, METH_NOARGS,
+      "readline() -> bytes\n\nNext line, with its delimiter; b'' at end of input." },
+    { "batch", (PyCFunction)(void (*)(void))Scanner_batch,
+      METH_VARARGS | METH_KEYWORDS,
+      "batch(maxrows=65536, maxbytes=1<<24) -> (data, offsets, valid) or None\n\n"
+      "Next batch of lines, less delimiters: data, a read-only memoryview of\n"
+      "them end to end, and offsets, a numpy int64 array of len(lines) + 1\n"
+      "offsets into data (a memoryview of format 'q' without numpy).  valid\n"
+      "is None if every line fit the scan buffer, else a numpy bool array,\n"
+      "False for each (empty) long line (the packed Arrow validity bitmap,\n"
+      "as a memoryview of bytes, without numpy).\n"
+      "Returns None at end of input." },
+    { "close", (PyCFunction)Scanner_close, METH_NOARGS,
+      "close()\n\nStop scanning; leaves the underlying file open." },
+    { "__enter__", (PyCFunction)Scanner_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction)Scanner_exit, METH_VARARGS, NULL },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject ScannerType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "rawscan.Scanner",
+    .tp_basicsize = sizeof(ScannerObject),
+    .tp_dealloc = (destructor)Scanner_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Scanner(file, bufsize=1<<20, delimiter=b'\\n')\n\n"
+              "Scan lines from file, an int file descriptor or an object\n"
+              "with a fileno() method, which is left open when done.",
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)Scanner_iternext,
+    .tp_methods = Scanner_methods,
+    .tp_init = (initproc)Scanner_init,
+    .tp_new = PyType_GenericNew,
+};
+
+static struct PyModuleDef rawscanmodule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "rawscan",
+    .m_doc = "Read lines, or batches of lines, quickly, using rawscan.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_rawscan(void)
+{
+    PyObject *m;
+
+    if (PyType_Ready(&BufferType) < 0 || PyType_Ready(&ScannerType) < 0)
+        return NULL;
+    if ((m = PyModule_Create(&rawscanmodule)) == NULL)
+        return NULL;
+    Py_INCREF(&ScannerType);
+    if (PyModule_AddObject(m, "Scanner", (PyObject *)&ScannerType) < 0) {
+        Py_DECREF(&ScannerType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,23 @@
+# Build the rawscan Python extension module:
+#
+#       python3 setup.py build_ext --inplace
+#
+# The rawscan library itself is compiled into the module, from
+# ../lib/rawscan.c, so no librawscan.so need be installed.
+
+from setuptools import setup, Extension
+
+setup(
+    name="rawscan",
+    version="0.1.4",
+    description="Read character (byte) terminated lines or records",
+    ext_modules=[
+        Extension(
+            "rawscan",
+            sources=["rawscanmodule.c", "../lib/rawscan.c"],
+            include_dirs=["../include"],
+            extra_compile_args=["-std=gnu11", "-march=native", "-O3"],
+            libraries=["pthread"],
+        )
+    ],
+)
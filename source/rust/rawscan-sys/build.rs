@@ -0,0 +1,20 @@
+// Compile the rawscan library, from the C source two directories up,
+// into a static library linked into this crate.
+
+fn main() {
+    let src = "../../lib/rawscan.c";
+    let include = "../../include";
+
+    println!("cargo:rerun-if-changed={}", src);
+    println!("cargo:rerun-if-changed={}/rawscan.h", include);
+    println!("cargo:rerun-if-changed={}/rawscan_static.h", include);
+
+    cc::Build::new()
+        .file(src)
+        .include(include)
+        .flag("-std=gnu11")
+        .warnings(false)
+        .compile("rawscan");
+
+    println!("cargo:rustc-link-lib=pthread");
+}
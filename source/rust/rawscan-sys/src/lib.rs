@@ -0,0 +1,66 @@
+//! Raw FFI bindings to the core rawscan line scanning calls, as
+//! declared in `rawscan.h`.  See the `rawscan` crate for a safe
+//! wrapper.  Note that each `rs_getline()` might invalidate the
+//! pointers returned by prior calls, unless pause is enabled.
+
+#![allow(non_camel_case_types)]
+#![allow(non_upper_case_globals)]
+
+use std::os::raw::{c_char, c_int, c_uint};
+
+/// Opaque rawscan stream.
+#[repr(C)]
+pub struct RAWSCAN {
+    _private: [u8; 0],
+}
+
+/// The kinds of RAWSCAN_RESULT that rs_getline() returns.
+pub type rs_result_type = c_uint;
+
+// The RAWSCAN_RESULT line begin and end fields are valid:
+pub const rt_full_line: rs_result_type = 0;
+pub const rt_full_line_without_eol: rs_result_type = 1;
+pub const rt_start_longline: rs_result_type = 2;
+pub const rt_within_longline: rs_result_type = 3;
+pub const rt_longline_ended: rs_result_type = 4; // (begin, end both NULL)
+
+// No further RAWSCAN_RESULT fields are valid:
+pub const rt_paused: rs_result_type = 5;
+pub const rt_eof: rs_result_type = 6;
+
+// The RAWSCAN_RESULT errnum field is valid:
+pub const rt_err: rs_result_type = 7;
+
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub struct RAWSCAN_LINE {
+    pub begin: *const c_char, // first byte in line or chunk
+    pub end: *const c_char,   // last byte in line or chunk
+}
+
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub union RAWSCAN_RESULT_U {
+    pub line: RAWSCAN_LINE,
+    pub errnum: c_int,
+}
+
+#[repr(C)]
+#[derive(Copy, Clone)]
+pub struct RAWSCAN_RESULT {
+    pub type_: rs_result_type,
+    pub u: RAWSCAN_RESULT_U,
+}
+
+extern "C" {
+    pub fn rs_open(fd: c_int, bufsz: usize, delimiterbyte: c_char) -> *mut RAWSCAN;
+    pub fn rs_close(rsp: *mut RAWSCAN);
+    pub fn rs_reopen(rsp: *mut RAWSCAN, fd: c_int);
+    pub fn rs_enable_pause(rsp: *mut RAWSCAN);
+    pub fn rs_disable_pause(rsp: *mut RAWSCAN);
+    pub fn rs_resume_from_pause(rsp: *mut RAWSCAN);
+    pub fn rs_release_upto(rsp: *mut RAWSCAN, ptr: *const c_char);
+    pub fn rs_get_shift_total(rsp: *mut RAWSCAN) -> usize;
+    pub fn rs_getline(rsp: *mut RAWSCAN) -> RAWSCAN_RESULT;
+    pub fn rs_peekline(rsp: *mut RAWSCAN) -> RAWSCAN_RESULT;
+}
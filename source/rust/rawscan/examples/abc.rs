@@ -0,0 +1,37 @@
+// Same test as tests/rust_bstr and tests/rust_bufreader: copy the
+// lines on stdin that start with "abc" to stdout, here using rawscan.
+
+use std::io::{self, Write};
+
+use rawscan::{Line, Scanner};
+
+fn main() -> io::Result<()> {
+    let stdin = io::stdin();
+    let mut stdout = io::BufWriter::new(io::stdout());
+    let mut sc = Scanner::new(stdin, 1 << 20, b'\n')?;
+    let mut in_abc_longline = false;
+
+    loop {
+        match sc.next_line()? {
+            Line::Full(line) | Line::FullWithoutEol(line) => {
+                if line.starts_with(b"abc") {
+                    stdout.write_all(line)?;
+                }
+            }
+            Line::StartLong(chunk) => {
+                in_abc_longline = chunk.starts_with(b"abc");
+                if in_abc_longline {
+                    stdout.write_all(chunk)?;
+                }
+            }
+            Line::WithinLong(chunk) => {
+                if in_abc_longline {
+                    stdout.write_all(chunk)?;
+                }
+            }
+            Line::LongEnded | Line::Paused => {}
+            Line::Eof => break,
+        }
+    }
+    stdout.flush()
+}
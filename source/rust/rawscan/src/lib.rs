@@ -0,0 +1,203 @@
+//! Safe wrapper over rawscan.
+//!
+//! rawscan returns each line as a pointer into its input buffer, with
+//! zero copies, but each `rs_getline()` might invalidate the lines
+//! returned before it.  Here that rule is kept by the borrow checker,
+//! at no run time cost: [`Scanner::next_line`] borrows the scanner
+//! mutably for as long as the [`Line`] it returns is in use, so the
+//! next call can't be made until that line is done with.
+//!
+//! ```no_run
+//! use rawscan::{Line, Scanner};
+//!
+//! let mut sc = Scanner::new(std::io::stdin(), 1 << 20, b'\n').unwrap();
+//! loop {
+//!     match sc.next_line().unwrap() {
+//!         Line::Full(line) => { /* line: &[u8], with its b'\n' */ }
+//!         Line::Eof => break,
+//!         _ => {}                     // long line chunks, ...
+//!     }
+//! }
+//! ```
+//!
+//! To keep several lines at once, [`Scanner::pause`] enables rawscan's
+//! pause feature and returns a [`Paused`] guard.  Lines it returns
+//! borrow the guard, not each call, so all stay valid together, until
+//! the buffer fills, when [`Paused::next_line`] returns [`Line::Paused`].
+//! Dropping the guard resumes the stream, which the borrow checker
+//! won't allow while any of its lines are still in use.
+//!
+//! A line can't be held across the next call, outside of a pause:
+//!
+//! ```compile_fail
+//! # use rawscan::Scanner;
+//! let mut sc = Scanner::new(std::io::stdin(), 1 << 20, b'\n').unwrap();
+//! let first = sc.next_line().unwrap();
+//! let second = sc.next_line().unwrap();   // error: sc already borrowed
+//! println!("{:?} {:?}", first, second);
+//! ```
+//!
+//! rawscan buffers can never be freed (see `rs_close` in rawscan.h),
+//! so reuse a Scanner for further inputs with [`Scanner::reopen`]
+//! rather than creating more of them.
+
+use std::cell::Cell;
+use std::io;
+use std::marker::PhantomData;
+use std::os::unix::io::AsRawFd;
+use std::ptr::NonNull;
+use std::slice;
+
+use rawscan_sys as sys;
+
+/// One result from a scanner: a line, a chunk of a long line, or why
+/// there is none.  Slices point into the scanner's buffer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Line<'a> {
+    /// One entire line, ending with the delimiter byte.
+    Full(&'a [u8]),
+    /// The last line of input, which had no delimiter byte.
+    FullWithoutEol(&'a [u8]),
+    /// First chunk of a line too long to fit in the buffer.
+    StartLong(&'a [u8]),
+    /// Another chunk of that long line.
+    WithinLong(&'a [u8]),
+    /// No more chunks in that long line (no data).
+    LongEnded,
+    /// Paused: no more lines until the pause guard is dropped.
+    Paused,
+    /// End of input.
+    Eof,
+}
+
+impl<'a> Line<'a> {
+    /// The bytes of a line or chunk, if this result has any.
+    pub fn bytes(&self) -> Option<&'a [u8]> {
+        match *self {
+            Line::Full(b) | Line::FullWithoutEol(b) | Line::StartLong(b) | Line::WithinLong(b) => {
+                Some(b)
+            }
+            _ => None,
+        }
+    }
+}
+
+/// Convert a RAWSCAN_RESULT, whose line, if any, lives for 'a.
+unsafe fn line<'a>(rt: sys::RAWSCAN_RESULT) -> io::Result<Line<'a>> {
+    let bytes = || {
+        let l = rt.u.line;
+        slice::from_raw_parts(l.begin as *const u8, l.end.offset_from(l.begin) as usize + 1)
+    };
+    Ok(match rt.type_ {
+        sys::rt_full_line => Line::Full(bytes()),
+        sys::rt_full_line_without_eol => Line::FullWithoutEol(bytes()),
+        sys::rt_start_longline => Line::StartLong(bytes()),
+        sys::rt_within_longline => Line::WithinLong(bytes()),
+        sys::rt_longline_ended => Line::LongEnded,
+        sys::rt_paused => Line::Paused,
+        sys::rt_eof => Line::Eof,
+        _ => return Err(io::Error::from_raw_os_error(rt.u.errnum)),
+    })
+}
+
+/// A rawscan stream, reading lines from `F`, which it owns, so that
+/// its file descriptor stays open as long as the scanner uses it.
+pub struct Scanner<F: AsRawFd> {
+    raw: NonNull<sys::RAWSCAN>,
+    file: F,
+    _not_sync: PhantomData<*mut sys::RAWSCAN>,
+}
+
+// A stream may move between threads, but isn't safe to share.
+unsafe impl<F: AsRawFd + Send> Send for Scanner<F> {}
+
+impl<F: AsRawFd> Scanner<F> {
+    /// Open a scanner on `file`, with a `bufsz` byte buffer, for lines
+    /// ending in `delimiter`.
+    pub fn new(file: F, bufsz: usize, delimiter: u8) -> io::Result<Scanner<F>> {
+        let rsp = unsafe { sys::rs_open(file.as_raw_fd(), bufsz, delimiter as _) };
+        match NonNull::new(rsp) {
+            Some(raw) => Ok(Scanner { raw, file, _not_sync: PhantomData }),
+            None => Err(io::Error::new(io::ErrorKind::OutOfMemory, "rs_open failed")),
+        }
+    }
+
+    /// Next line, or chunk of a long line, valid until the next call.
+    pub fn next_line(&mut self) -> io::Result<Line<'_>> {
+        unsafe { line(sys::rs_getline(self.raw.as_ptr())) }
+    }
+
+    /// Look at the next line without consuming it; the next call to
+    /// `next_line` returns it again.  Returns `Line::Paused` where the
+    /// next line can't be had without moving the buffer; `next_line`
+    /// then gets it.
+    pub fn peek_line(&mut self) -> io::Result<Line<'_>> {
+        unsafe { line(sys::rs_peekline(self.raw.as_ptr())) }
+    }
+
+    /// Enable pause, so that lines stay valid across calls, until the
+    /// returned guard is dropped.
+    pub fn pause(&mut self) -> Paused<'_, F> {
+        unsafe { sys::rs_enable_pause(self.raw.as_ptr()) };
+        Paused { scanner: self, hit_pause: Cell::new(false) }
+    }
+
+    /// Rebind this scanner, and its buffer, to a new input; returns
+    /// the old one.
+    pub fn reopen(&mut self, file: F) -> F {
+        unsafe { sys::rs_reopen(self.raw.as_ptr(), file.as_raw_fd()) };
+        std::mem::replace(&mut self.file, file)
+    }
+
+    /// The input this scanner reads.
+    pub fn get_ref(&self) -> &F {
+        &self.file
+    }
+}
+
+impl<F: AsRawFd> Drop for Scanner<F> {
+    fn drop(&mut self) {
+        unsafe { sys::rs_close(self.raw.as_ptr()) };
+    }
+}
+
+/// Guard over a paused-enabled scanner.  Lines returned by
+/// [`Paused::next_line`] borrow the guard, so they all stay valid
+/// until it is dropped, which resumes and disables pause.
+pub struct Paused<'s, F: AsRawFd> {
+    scanner: &'s mut Scanner<F>,
+    hit_pause: Cell<bool>,
+}
+
+impl<'s, F: AsRawFd> Paused<'s, F> {
+    /// Next line, valid as long as this guard.  Returns [`Line::Paused`]
+    /// once the buffer is full; drop the guard to make room for more.
+    pub fn next_line(&self) -> io::Result<Line<'_>> {
+        // The stream doesn't move or overwrite returned data while
+        // paused, so earlier lines stay valid as more are returned.
+        let l = unsafe { line(sys::rs_getline(self.scanner.raw.as_ptr())) };
+        if let Ok(Line::Paused) = l {
+            self.hit_pause.set(true);
+        }
+        l
+    }
+
+    /// Resume: same as dropping the guard.
+    pub fn resume(self) {}
+}
+
+impl<'s, F: AsRawFd> Drop for Paused<'s, F> {
+    fn drop(&mut self) {
+        let rsp = self.scanner.raw.as_ptr();
+
+        // Disable first: rs_disable_pause() clears any resume.  Only
+        // resume a pause actually hit, as a resume latched early would
+        // let the stream overwrite a later guard's lines.
+        unsafe {
+            sys::rs_disable_pause(rsp);
+            if self.hit_pause.get() {
+                sys::rs_resume_from_pause(rsp);
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Check rawdedup_test (rs_dedup()) against "awk '!s[$0]++'" and
+# uniq, for buffer sizes from smaller than most lines on up.  The
+# input has runs of repeated lines, empty lines, lines longer than
+# the smaller buffers, and a last line, a repeat, lacking its final
+# newline.  With memsz too small to hold all the distinct lines,
+# rs_dedup() spills some of them, perhaps more than once over, and
+# outputs those after the rest, so then only the sorted output is
+# checked, and that each line is output once.
+
+PATH=.:$PATH
+LC_ALL=C
+export LC_ALL
+tmp=/tmp/dedup_test.$$
+trap 'rm -rf $tmp $tmp.*; trap 0; exit' 0 1 2 3 15
+mkdir $tmp
+
+awk 'BEGIN {
+    srand(1)
+    for (i = 0; i < 4000; i++) {
+        k = int(rand() * 600)
+        if (k % 61 == 0)
+            line = ""
+        else if (k % 37 == 0)
+            line = sprintf("%0300d", k)
+        else
+            line = "line " k
+        for (n = int(rand() * 3); n >= 0; n--)
+            print line
+    }
+    printf "line 7"
+}' > $tmp.in
+
+awk '!s[$0]++' $tmp.in > $tmp.global
+sort $tmp.global > $tmp.global.sorted
+uniq $tmp.in > $tmp.adjacent
+
+for bufsz in 4 16 64 1024 65536
+do
+    if ! rawdedup_test -b $bufsz < $tmp.in | cmp -s - $tmp.global
+    then
+        echo FAILED: rawdedup_test -b $bufsz
+        exit 1
+    fi
+    if ! rawdedup_test -a -b $bufsz < $tmp.in | cmp -s - $tmp.adjacent
+    then
+        echo FAILED: rawdedup_test -a -b $bufsz
+        exit 1
+    fi
+    for memsz in 9000 12000 40000
+    do
+        rawdedup_test -b $bufsz -m $memsz -T $tmp < $tmp.in > $tmp.out ||
+        {
+            echo FAILED: rawdedup_test -b $bufsz -m $memsz: exit status $?
+            exit 1
+        }
+        if ! sort $tmp.out | cmp -s - $tmp.global.sorted
+        then
+            echo FAILED: rawdedup_test -b $bufsz -m $memsz
+            exit 1
+        fi
+    done
+done
+
+echo dedup_test: passed
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Check rawfiles_test (rs_open_files(), rs_get_file_index()), with
+# and without rs_peekline() before each line, against awk's view of
+# the same files, each named for its index.  A peek past the last
+# line of a file must not change the file index of that line.  Files
+# end with or without a final newline, some are empty, and one holds
+# a line longer than the smaller buffer sizes.
+
+PATH=.:$PATH
+dir=/tmp/files_peek_test.$$
+trap 'rm -rf $dir; trap 0; exit' 0 1 2 3 15
+mkdir $dir
+
+printf 'a1\na2' > $dir/0
+printf 'b1\n' > $dir/1
+: > $dir/2
+printf 'd1\nd2 is a longer line, of more than thirty two bytes\nd3' > $dir/3
+printf '\n\ne3\n' > $dir/4
+printf 'f1' > $dir/5
+
+files="$dir/0 $dir/1 $dir/2 $dir/3 $dir/4 $dir/5"
+expect=$(awk '{ n = split(FILENAME, f, "/"); print f[n] "\t" $0 }' $files)
+
+for bufsz in 4 8 16 32 64 16384
+do
+    for peek in "" -p
+    do
+        got=$(rawfiles_test -b $bufsz $peek $files)
+        if test "$got" != "$expect"
+        then
+            echo FAILED: rawfiles_test -b $bufsz $peek
+            exit 1
+        fi
+    done
+done
+
+echo files_peek_test: passed
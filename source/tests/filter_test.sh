@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Check rawfilter_test (rs_getline_filtered()) against grep -F and
+# grep -iF, and against grep '^...' and '...$' for prefix filters and
+# literals ending with the delimiter, for buffer sizes from a few
+# lines on up, so that the search of all the lines in the buffer at
+# once, and the match it found, carry across refills.  Lines hold the
+# literals in mixed case, at various offsets, so that the vector
+# compare of both cases of two bytes, and the byte at a time tail,
+# both find them.  Long lines hold their matches near their start,
+# where rs_getline_filtered() looks for them, and the last line lacks
+# a final newline.
+
+PATH=.:$PATH
+LC_ALL=C
+export LC_ALL
+tmp=/tmp/filter_test.$$
+trap 'rm -f $tmp.*; trap 0; exit' 0 1 2 3 15
+
+awk 'BEGIN {
+    srand(1)
+    n = split("Xyzzy xYzZy xyzzy QUUX quux Quux warn Warning WARN end " \
+              "fend the_quick_brown_fox THE_QUICK_BROWN_FOX z Z a b c " \
+              "lorem ipsum dolor sit amet", w, " ")
+    for (i = 0; i < 5000; i++) {
+        if (i % 97 == 0) {
+            printf "%s %0300d\n", w[1 + int(rand() * 9)], i
+            continue
+        }
+        line = ""
+        for (k = int(rand() * 6); k >= 0; k--) {
+            word = (rand() < 0.5 ? "" : " ") w[1 + int(rand() * n)]
+            if (length(line word) > 60)
+                break
+            line = line word
+        }
+        print line
+    }
+    printf "last Xyzzy line"
+}' > $tmp.in
+
+check()         # grep pattern and options, then rawfilter_test options
+{
+    pattern=$1
+    gopts=$2
+    shift 2
+    grep $gopts -e "$pattern" $tmp.in > $tmp.expect
+    for bufsz in 64 100 256 1000 65536
+    do
+        if ! rawfilter_test -b $bufsz "$@" < $tmp.in | cmp -s - $tmp.expect
+        then
+            echo FAILED: rawfilter_test -b $bufsz "$@"
+            exit 1
+        fi
+    done
+}
+
+for literal in xyzzy Xyzzy quux QUUX the_quick_brown_fox z amet
+do
+    check $literal -F $literal
+    check $literal -iF -i $literal
+done
+check '^warn' '' -p warn
+check '^warn' -i -i -p warn
+check '^WARN ' '' -p 'WARN '
+check 'end$' '' -d end
+check 'END$' -i -i -d END
+
+echo filter_test: passed
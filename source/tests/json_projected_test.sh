@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Check rawjson_test (rs_getline_projected()) on records whose first
+# line ends within a string, so that the record continues on the
+# next line.  Requiring a path mustn't change how such records are
+# split, nor drop records that have it.  Try buffer sizes from too
+# small for any record (long lines) on up.
+
+PATH=.:$PATH
+input=/tmp/json_projected_test.$$
+trap 'rm -f $input; trap 0; exit' 0 1 2 3 15
+
+printf '%s\n' \
+    '{"msg":"line one' \
+    'still msg","user":{"id":7}}' \
+    '{"user":{"id":8}}' \
+    '{"skip":"no id, and ends' \
+    'in a string"}' \
+    '{"user":{"id":9}}' > $input
+
+expect_all='7
+8
+-
+9'
+expect_required='7
+8
+9'
+
+for bufsz in 4 8 16 32 64 16384
+do
+    got=$(rawjson_test -b $bufsz user.id < $input)
+    if test "$got" != "$expect_all"
+    then
+        echo FAILED: rawjson_test -b $bufsz user.id
+        exit 1
+    fi
+    got=$(rawjson_test -b $bufsz -r user.id < $input)
+    if test "$got" != "$expect_required"
+    then
+        echo FAILED: rawjson_test -b $bufsz -r user.id
+        exit 1
+    fi
+done
+
+echo json_projected_test: passed
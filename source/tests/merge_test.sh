@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# Check rawmerge_test (rs_merge_open(), rs_merge_next()) against
+# "LC_ALL=C sort -m", forwards and, with a cmp function, in reverse,
+# with and without pause mode, for buffer sizes from smaller than
+# most lines on up.  The inputs share some lines, hold lines longer
+# than the smaller buffers, and lines that are prefixes of others;
+# one is empty, and one's last line lacks a final newline.
+
+PATH=.:$PATH
+LC_ALL=C
+export LC_ALL
+tmp=/tmp/merge_test.$$
+trap 'rm -f $tmp.*; trap 0; exit' 0 1 2 3 15
+
+for i in 0 1 2 3
+do
+    awk -v seed=$i 'BEGIN {
+        srand(seed + 1)
+        for (j = 0; j < 300; j++) {
+            k = int(rand() * 400)
+            if (k % 23 == 0)
+                print sprintf("%0200d", k)
+            else if (k % 5 == 0)
+                print "x" k
+            else
+                print "x" k "-" seed
+        }
+    }' > $tmp.$i
+done
+: > $tmp.empty
+sort $tmp.0 > $tmp.a
+sort $tmp.1 > $tmp.b
+sort $tmp.2 | awk '{ printf "%s%s", sep, $0; sep = "\n" }' > $tmp.c
+sort $tmp.3 > $tmp.d
+sort -r $tmp.0 > $tmp.ra
+sort -r $tmp.1 > $tmp.rb
+sort -r $tmp.2 | awk '{ printf "%s%s", sep, $0; sep = "\n" }' > $tmp.rc
+sort -r $tmp.3 > $tmp.rd
+
+sort -m $tmp.a $tmp.empty $tmp.b $tmp.c $tmp.d > $tmp.expect
+sort -m -r $tmp.ra $tmp.empty $tmp.rb $tmp.rc $tmp.rd > $tmp.rexpect
+
+for bufsz in 4 16 64 1024 65536
+do
+    for pause in "" -p
+    do
+        if ! rawmerge_test -b $bufsz $pause $tmp.a $tmp.empty $tmp.b \
+                $tmp.c $tmp.d | cmp -s - $tmp.expect
+        then
+            echo FAILED: rawmerge_test -b $bufsz $pause
+            exit 1
+        fi
+        if ! rawmerge_test -b $bufsz $pause -r $tmp.ra $tmp.empty $tmp.rb \
+                $tmp.rc $tmp.rd | cmp -s - $tmp.rexpect
+        then
+            echo FAILED: rawmerge_test -b $bufsz $pause -r
+            exit 1
+        fi
+    done
+done
+
+echo merge_test: passed
@@ -0,0 +1,63 @@
+#include <rawscan.h>
+
+/*
+ * < input rawdedup_test [-a] [-b bufsz] [-m memsz] [-T tmpdir] > output
+ *
+ * Copy input lines less duplicates, using rs_dedup(): all repeats
+ * of a line seen before, as "awk '!s[$0]++'" does (though lines that
+ * spill to tmpdir come out after the rest), or with -a, only repeats
+ * of the line just before, as uniq does.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define default_buffer_size (64*1024)
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    size_t memsz = 0;           // 0: rs_dedup() default
+    enum rs_dedup_mode mode = rs_dedup_global;
+    const char *tmpdir = NULL;  // NULL: $TMPDIR or /tmp
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "ab:m:T:")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'a':
+                mode = rs_dedup_adjacent;
+                break;
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawdedup_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'm':
+                memsz = strtoul(optarg, &optend, 0);
+                break;
+            case 'T':
+                tmpdir = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawdedup_test [-a] [-b bufsz] "
+                                        "[-m memsz] [-T tmpdir]\n");
+                exit(1);
+        }
+    }
+
+    if (rs_dedup(0, 1, bufsz, '\n', mode, memsz, tmpdir) < 0) {
+        perror("rawdedup_test: rs_dedup");
+        exit(1);
+    }
+    exit(0);
+}
@@ -0,0 +1,111 @@
+#include <rawscan.h>
+
+/*
+ * rawfiles_test [-b bufsz] [-p] path ... > output
+ *
+ * Scan the files as one stream, using rs_open_files(), printing each
+ * line, prefixed by the rs_get_file_index() of the file it came from
+ * and a tab.  With -p, rs_peekline() before each rs_getline(), and
+ * fail if the peek changes the file index of the line just returned,
+ * or if the next rs_getline() doesn't return what was peeked.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define default_buffer_size (16*1024)
+
+static void fail(const char *msg)
+{
+    fprintf(stderr, "Fatal error: rawfiles_test: %s\n", msg);
+    exit(1);
+}
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    bool peek = false, midline = false;
+    char last = '\n';
+    RAWSCAN *rsp;
+    RAWSCAN_RESULT rt, pk;
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:p")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawfiles_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'p':
+                peek = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawfiles_test [-b bufsz] [-p] path ...\n");
+                exit(1);
+        }
+    }
+
+    if ((rsp = rs_open_files((const char *const *)argv + optind,
+                             argc - optind, bufsz, '\n')) == NULL) {
+        perror("rawfiles_test: rs_open_files");
+        exit(1);
+    }
+
+    for (;;) {
+        if (peek) {
+            size_t file_index = rs_get_file_index(rsp);
+
+            pk = rs_peekline(rsp);
+            if (rs_get_file_index(rsp) != file_index)
+                fail("rs_peekline() changed rs_get_file_index()");
+            rt = rs_getline(rsp);
+            if (pk.type != rt_paused && (pk.type != rt.type ||
+                    pk.line.begin != rt.line.begin ||
+                    pk.line.end != rt.line.end))
+                fail("rs_getline() didn't return what was peeked");
+        } else {
+            rt = rs_getline(rsp);
+        }
+
+        switch (rt.type) {
+            case rt_full_line:
+            case rt_full_line_without_eol:
+            case rt_start_longline:
+            case rt_within_longline:
+                if (!midline)
+                    printf("%zu\t", rs_get_file_index(rsp));
+                fwrite(rt.line.begin, 1, rt.line.end - rt.line.begin + 1,
+                       stdout);
+                midline = rt.type == rt_start_longline ||
+                          rt.type == rt_within_longline;
+                last = *rt.line.end;
+                if (rt.type == rt_full_line_without_eol)
+                    putchar('\n');
+                break;
+            case rt_longline_ended:
+                if (last != '\n')              // ended at end of file
+                    putchar('\n');
+                midline = false;
+                break;
+            case rt_paused:                     // (pause isn't enabled)
+                break;
+            case rt_eof:
+                rs_close(rsp);
+                exit(0);
+            case rt_err:
+                perror("rawfiles_test: rs_getline");
+                exit(1);
+        }
+    }
+}
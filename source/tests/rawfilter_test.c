@@ -0,0 +1,138 @@
+#include <rawscan.h>
+
+/*
+ * < input rawfilter_test [-b bufsz] [-d] [-i] [-p] literal > output
+ *
+ * Print the input lines holding literal, as "grep -F" does, using
+ * rs_getline_filtered().  With -d, the literal is followed by a
+ * newline, so it matches only at the end of a line, as grep with a
+ * trailing '$' does.  With -i, ignore ASCII case (RS_FILTER_NOCASE),
+ * as "grep -i".  With -p, match only at the start of lines
+ * (RS_FILTER_PREFIX), as grep with a leading '^'.  Fail if the span
+ * of a match isn't the literal, or isn't in the line returned.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define default_buffer_size (16*1024)
+
+static void fail(const char *msg)
+{
+    fprintf(stderr, "Fatal error: rawfilter_test: %s\n", msg);
+    exit(1);
+}
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    bool delim = false, nocase = false, prefix = false;
+    char *literal;
+    size_t len;
+    RAWSCAN *rsp;
+    RAWSCAN_FILTER *fp;
+    RAWSCAN_RESULT rt;
+    RAWSCAN_SPAN match;
+    char last = '\n';
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:dip")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawfilter_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'd':
+                delim = true;
+                break;
+            case 'i':
+                nocase = true;
+                break;
+            case 'p':
+                prefix = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawfilter_test [-b bufsz] [-d] [-i] "
+                                        "[-p] literal\n");
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: rawfilter_test [-b bufsz] [-d] [-i] "
+                                "[-p] literal\n");
+        exit(1);
+    }
+
+    len = strlen(argv[optind]);
+    if ((literal = malloc(len + 1)) == NULL) {
+        perror("rawfilter_test: malloc");
+        exit(1);
+    }
+    memcpy(literal, argv[optind], len);
+    if (delim)
+        literal[len++] = '\n';
+
+    if ((fp = rs_filter_open(literal, len,
+                    (nocase ? RS_FILTER_NOCASE : 0) |
+                    (prefix ? RS_FILTER_PREFIX : 0))) == NULL) {
+        perror("rawfilter_test: rs_filter_open");
+        exit(1);
+    }
+    if ((rsp = rs_open(0, bufsz, '\n')) == NULL) {
+        perror("rawfilter_test: rs_open");
+        exit(1);
+    }
+
+    for (;;) {
+        rt = rs_getline_filtered(rsp, fp, &match);
+        switch (rt.type) {
+            case rt_full_line:
+            case rt_full_line_without_eol:
+            case rt_start_longline:
+                if (match.begin < rt.line.begin || match.end > rt.line.end ||
+                        (size_t)(match.end - match.begin + 1) != len)
+                    fail("match span not within line");
+                if (prefix && match.begin != rt.line.begin)
+                    fail("prefix match not at start of line");
+                if ((nocase ? strncasecmp(match.begin, literal, len) :
+                              memcmp(match.begin, literal, len)) != 0)
+                    fail("match span doesn't hold literal");
+                /* fall through */
+            case rt_within_longline:
+                if (rt.type == rt_within_longline && match.begin != NULL)
+                    fail("match set for later chunk of long line");
+                fwrite(rt.line.begin, 1, rt.line.end - rt.line.begin + 1,
+                       stdout);
+                last = *rt.line.end;
+                if (rt.type == rt_full_line_without_eol)
+                    putchar('\n');
+                break;
+            case rt_longline_ended:
+                if (last != '\n')              // ended at end of file
+                    putchar('\n');
+                break;
+            case rt_paused:                     // (pause isn't enabled)
+                break;
+            case rt_eof:
+                rs_filter_close(fp);
+                rs_close(rsp);
+                free(literal);
+                exit(0);
+            case rt_err:
+                perror("rawfilter_test: rs_getline_filtered");
+                exit(1);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#include <rawscan.h>
+
+/*
+ * < input rawjson_test [-b bufsz] [-r] path ... > output
+ *
+ * For each JSON Lines record, print the values of the given key
+ * paths (such as "user.id"), tab separated, "-" for those absent,
+ * using rs_getline_projected().  With -r, all paths are required,
+ * so records lacking any are skipped.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define default_buffer_size (16*1024)
+#define max_paths 64
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    bool required = false;
+    RAWSCAN *rsp;
+    RAWSCAN_JSONPATHS *pp;
+    RAWSCAN_JSON json;
+    RAWSCAN_SPAN values[max_paths];
+    RAWSCAN_RESULT rt;
+    size_t npaths, i;
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:r")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawjson_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'r':
+                required = true;
+                break;
+            default:
+                goto usage;
+        }
+    }
+    npaths = argc - optind;
+    if (npaths < 1 || npaths > max_paths)
+        goto usage;
+
+    if ((rsp = rs_open(0, bufsz, '\n')) == NULL ||
+            (pp = rs_json_paths_open((const char *const *)argv + optind,
+                npaths, required ? UINT64_MAX >> (64 - npaths) : 0)) == NULL) {
+        perror("rawjson_test: open");
+        exit(1);
+    }
+
+    while ((rt = rs_getline_projected(rsp, pp, &json, values)).type
+                                                        != rt_eof) {
+        if (rt.type == rt_err) {
+            perror("rawjson_test: rs_getline_projected");
+            exit(1);
+        }
+        for (i = 0; i < npaths; i++) {
+            if (i > 0)
+                putchar('\t');
+            if (values[i].begin == NULL)
+                putchar('-');
+            else
+                fwrite(values[i].begin, 1,
+                       values[i].end - values[i].begin + 1, stdout);
+        }
+        putchar('\n');
+    }
+
+    rs_json_paths_close(pp);
+    rs_close(rsp);
+    exit(0);
+
+  usage:
+    fprintf(stderr, "Usage: rawjson_test [-b bufsz] [-r] path ...\n");
+    exit(1);
+}
@@ -0,0 +1,111 @@
+#include <rawscan.h>
+
+/*
+ * rawmerge_test [-b bufsz] [-p] [-r] path ... > output
+ *
+ * Merge the lines of the files, each already sorted, as
+ * "LC_ALL=C sort -m" does, using rs_merge_open() over one stream
+ * per file.  With -p, the streams are in pause mode.  With -r, the
+ * files are in reverse order, as "LC_ALL=C sort -m -r" takes them,
+ * and lines are ordered by a cmp function, not the built in order.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define default_buffer_size (16*1024)
+
+static int reverse_cmp(void *arg, const char *a, size_t alen,
+                                  const char *b, size_t blen)
+{
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+
+    (void)arg;
+    if (c == 0)
+        c = (alen > blen) - (alen < blen);
+    return -c;
+}
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    bool pause = false, reverse = false;
+    RAWSCAN **rsps;
+    RAWSCAN_MERGE *mp;
+    RAWSCAN_RESULT rt;
+    size_t i, n;
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:pr")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawmerge_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'p':
+                pause = true;
+                break;
+            case 'r':
+                reverse = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawmerge_test [-b bufsz] [-p] [-r] "
+                                        "path ...\n");
+                exit(1);
+        }
+    }
+
+    n = argc - optind;
+    if ((rsps = calloc(n, sizeof(*rsps))) == NULL) {
+        perror("rawmerge_test: calloc");
+        exit(1);
+    }
+    for (i = 0; i < n; i++) {
+        int fd = open(argv[optind + i], O_RDONLY);
+
+        if (fd < 0) {
+            perror(argv[optind + i]);
+            exit(1);
+        }
+        if ((rsps[i] = rs_open(fd, bufsz, '\n')) == NULL) {
+            perror("rawmerge_test: rs_open");
+            exit(1);
+        }
+        if (pause)
+            rs_enable_pause(rsps[i]);
+    }
+
+    if ((mp = rs_merge_open(rsps, n, reverse ? reverse_cmp : NULL,
+                            NULL)) == NULL) {
+        perror("rawmerge_test: rs_merge_open");
+        exit(1);
+    }
+
+    while ((rt = rs_merge_next(mp)).type != rt_eof) {
+        if (rt.type == rt_err) {
+            perror("rawmerge_test: rs_merge_next");
+            exit(1);
+        }
+        fwrite(rt.line.begin, 1, rt.line.end - rt.line.begin + 1, stdout);
+        if (rt.type == rt_full_line_without_eol)
+            putchar('\n');
+    }
+
+    rs_merge_close(mp);
+    for (i = 0; i < n; i++)
+        rs_close(rsps[i]);
+    free(rsps);
+    exit(0);
+}
@@ -43,7 +43,7 @@ func_static void emit(RAWSCAN_RESULT rt)
             error_exit("rawscan write failed");
 }
 
-func_static void rawscan_test(int fd, size_t bufsz)
+func_static void rawscan_test(int fd, size_t bufsz, size_t max_readlen)
 {
     RAWSCAN *rsp;
     RAWSCAN_RESULT rt;
@@ -56,6 +56,8 @@ func_static void rawscan_test(int fd, size_t bufsz)
         error_exit("rawscan rs_open memory allocation failure");
 
     rs_set_min1stchunklen(rsp, abc_len);
+    if (max_readlen > 0 && rs_set_max_readlen(rsp, max_readlen) < 0)
+        error_exit("rawscan -r max_readlen larger than -b bufsz");
 
     for (;;) {
 
@@ -112,11 +114,12 @@ func_static void rawscan_test(int fd, size_t bufsz)
 int main (int argc, char **argv)
 {
     size_t bufsz = default_buffer_size;
+    size_t max_readlen = 0;     // 0: leave at default (bufsz)
     extern int optind;
     extern char *optarg;
     int c;
 
-    while ((c = getopt(argc, argv, "b:")) != EOF) {
+    while ((c = getopt(argc, argv, "b:r:")) != EOF) {
         char *optend;
 
         switch (c) {
@@ -128,12 +131,21 @@ int main (int argc, char **argv)
                     exit(1);
                 }
                 break;
+            case 'r':
+                max_readlen = strtoul(optarg, &optend, 0);
+                if (max_readlen < 1) {
+                    fprintf(stderr, "Fatal error: rawscan_static_test: "
+                                    "-r max_readlen must be >= 1\n");
+                    exit(1);
+                }
+                break;
             default:
-                fprintf(stderr, "Usage: rawscan_static_test [-b bufsz]\n");
+                fprintf(stderr, "Usage: rawscan_static_test [-b bufsz] "
+                                                "[-r max_readlen]\n");
                 exit(1);
         }
     }
 
-    rawscan_test(0, bufsz);     // 0: read input file descriptor
+    rawscan_test(0, bufsz, max_readlen);    // 0: read input file descriptor
     exit(0);                    // 0: exit successfully
 }
@@ -0,0 +1,60 @@
+#include <rawscan.h>
+
+/*
+ * < input rawsort_test [-b bufsz] [-m memsz] [-t nthreads] [-T tmpdir] > output
+ *
+ * Sort input lines byte-wise, as "LC_ALL=C sort" does, using rs_sort().
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define default_buffer_size (64*1024)
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    size_t memsz = 0;           // 0: rs_sort() default
+    int nthreads = 0;           // 0: one per online cpu
+    const char *tmpdir = NULL;  // NULL: $TMPDIR or /tmp
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:m:t:T:")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawsort_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'm':
+                memsz = strtoul(optarg, &optend, 0);
+                break;
+            case 't':
+                nthreads = strtol(optarg, &optend, 0);
+                break;
+            case 'T':
+                tmpdir = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawsort_test [-b bufsz] [-m memsz] "
+                                        "[-t nthreads] [-T tmpdir]\n");
+                exit(1);
+        }
+    }
+
+    if (rs_sort(0, 1, bufsz, '\n', memsz, nthreads, tmpdir) < 0) {
+        perror("rawsort_test: rs_sort");
+        exit(1);
+    }
+    exit(0);
+}
@@ -0,0 +1,100 @@
+#include <rawscan.h>
+
+/*
+ * rawsplit_test [-b bufsz] [-l nlines | -C nbytes] [-s start] [-a] input prefix
+ *
+ * Split input, from byte offset start (default 0), into pieces of
+ * nlines lines, or of at most nbytes bytes of whole lines, named
+ * prefix000, prefix001, ..., as "split -d -a 3 -l" or "-C" would,
+ * using rs_split().  With -a, the pieces are opened O_APPEND, which
+ * copy_file_range(2) refuses, so that rs_split() falls back to
+ * pread(2) and write(2).
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define default_buffer_size (64*1024)
+
+struct pieces {
+    const char *prefix;
+    int flags;
+};
+
+static int open_piece(void *arg, size_t i)
+{
+    struct pieces *pp = arg;
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s%03zu", pp->prefix, i);
+    return open(path, pp->flags, 0666);
+}
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    size_t nlines = 0, nbytes = 0;
+    off_t start = 0;
+    struct pieces pieces = { NULL, O_WRONLY|O_CREAT|O_TRUNC };
+    int fd;
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:l:C:s:a")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawsplit_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 'l':
+                nlines = strtoul(optarg, &optend, 0);
+                break;
+            case 'C':
+                nbytes = strtoul(optarg, &optend, 0);
+                break;
+            case 's':
+                start = strtoul(optarg, &optend, 0);
+                break;
+            case 'a':
+                pieces.flags |= O_APPEND;
+                break;
+            default:
+                fprintf(stderr, "Usage: rawsplit_test [-b bufsz] "
+                                "[-l nlines | -C nbytes] [-s start] [-a] "
+                                "input prefix\n");
+                exit(1);
+        }
+    }
+    if (optind != argc - 2) {
+        fprintf(stderr, "Usage: rawsplit_test [-b bufsz] "
+                        "[-l nlines | -C nbytes] [-s start] [-a] "
+                        "input prefix\n");
+        exit(1);
+    }
+
+    if ((fd = open(argv[optind], O_RDONLY)) < 0) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if (lseek(fd, start, SEEK_SET) < 0) {
+        perror("rawsplit_test: lseek");
+        exit(1);
+    }
+    pieces.prefix = argv[optind + 1];
+    if (rs_split(fd, nlines, nbytes, bufsz, '\n', open_piece, &pieces) < 0) {
+        perror("rawsplit_test: rs_split");
+        exit(1);
+    }
+    exit(0);
+}
@@ -0,0 +1,78 @@
+#include <rawscan.h>
+
+/*
+ * < input rawzframes_test [-b bufsz] [-t nthreads] > output
+ *
+ * Copy the lines of compressed (BGZF, gzip or zstd) input to output,
+ * decompressed, using rs_open_zframes().  The output should equal
+ * that of "gzip -dc" or "zstd -dc", byte for byte.  Exits 2 if
+ * rawscan was built without the library the input needs.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define default_buffer_size (64*1024)
+
+int main (int argc, char **argv)
+{
+    size_t bufsz = default_buffer_size;
+    int nthreads = 0;           // 0: one per online cpu
+    RAWSCAN *rsp;
+    RAWSCAN_RESULT rt;
+    extern int optind;
+    extern char *optarg;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:t:")) != EOF) {
+        char *optend;
+
+        switch (c) {
+            case 'b':
+                bufsz = strtoul(optarg, &optend, 0);
+                if (bufsz < 1 || bufsz > (1<<30)) {
+                    fprintf(stderr, "Fatal error: rawzframes_test: "
+                                    "-b bufsz not in [1, %u]\n", (1<<30));
+                    exit(1);
+                }
+                break;
+            case 't':
+                nthreads = strtol(optarg, &optend, 0);
+                break;
+            default:
+                fprintf(stderr, "Usage: rawzframes_test [-b bufsz] "
+                                        "[-t nthreads]\n");
+                exit(1);
+        }
+    }
+
+    if ((rsp = rs_open_zframes(0, bufsz, '\n', nthreads)) == NULL) {
+        int notsup = errno == ENOTSUP;          // (exit 2: not built in)
+
+        perror("rawzframes_test: rs_open_zframes");
+        exit(notsup ? 2 : 1);
+    }
+
+    while ((rt = rs_getline(rsp)).type != rt_eof) {
+        switch (rt.type) {
+            case rt_full_line:
+            case rt_full_line_without_eol:
+            case rt_start_longline:
+            case rt_within_longline:
+                fwrite(rt.line.begin, 1, rt.line.end - rt.line.begin + 1,
+                       stdout);
+                break;
+            case rt_err:
+                errno = rt.errnum;
+                perror("rawzframes_test: rs_getline");
+                exit(1);
+            default:
+                break;
+        }
+    }
+    rs_close(rsp);
+    exit(0);
+}
@@ -8,7 +8,8 @@
 #  1) number of lines in input,
 #  2) whether the last line has a trailing newline,
 #  3) the length of the lines, and
-#  4) the size of the rawscan buffer used.
+#  4) the size of the rawscan buffer used, and
+#  5) the most bytes rawscan reads at once (-r max_readlen).
 #
 # Test passes only if the rawscan reader output matches the
 # "sed -n /^abc/p" output, for all tests.
@@ -63,25 +64,34 @@ do
                 # final input line matches, but lacks such a newline.  The
                 # "sed" command matches what "rawscan_static_test" does.
 
+                # Reads of just 1 byte, or of half the buffer, as well as
+                # the default of a full buffer, to cover lines found over
+                # several rs_set_max_readlen() sized reads.
+
                 for rawscan_buf_sz_log2 in $(seq 2 6)
                 do
                     bufsz=$((2**rawscan_buf_sz_log2))
 
-                    ( ( { cat $shm.1 } \
-                        > >(rawscan_static_test -b $bufsz | md5sum 1>&3 ) \
-                        > >(sed -n /^abc/p | md5sum 1>&3 )
-                    ) 1>/dev/null ) 3>&1 |
-                    uniq -c |
-                    while read cnt sum input
+                    for max_readlen in "" 1 $((bufsz / 2))
                     do
-                        if test $cnt -ne 2
-                        then
-                            echo '\n'FAILED: '                       '
-                            echo '  ' ./random_line_generator -n $nlines \
-                              -m $minlen -M $maxlen -S $finaleol '|' \
-                              ./rawscan_static_test -b $bufsz
-                            exit 1
-                        fi
+                        ropt=(${max_readlen:+-r} $max_readlen)
+
+                        ( ( { cat $shm.1 } \
+                            > >(rawscan_static_test -b $bufsz $ropt | md5sum 1>&3 ) \
+                            > >(sed -n /^abc/p | md5sum 1>&3 )
+                        ) 1>/dev/null ) 3>&1 |
+                        uniq -c |
+                        while read cnt sum input
+                        do
+                            if test $cnt -ne 2
+                            then
+                                echo '\n'FAILED: '                       '
+                                echo '  ' ./random_line_generator -n $nlines \
+                                  -m $minlen -M $maxlen -S $finaleol '|' \
+                                  ./rawscan_static_test -b $bufsz $ropt
+                                exit 1
+                            fi
+                        done
                     done
                 done
             done
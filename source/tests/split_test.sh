@@ -0,0 +1,84 @@
+#!/bin/sh
+#
+# Check rawsplit_test (rs_split()) against "split -l" and "split -C",
+# piece by piece, with copy_file_range(2) and with its pread/write
+# fallback (-a), from the start of the input and from an offset
+# within a line, at buffer sizes smaller than the longest lines.
+# Also check that the pieces, put back together, are the input, and
+# that each "-l" piece but the last has nlines lines.  The input has
+# lines longer than the "-C" piece size, which are cut, and its last
+# line lacks a final newline.
+
+PATH=.:$PATH
+dir=/tmp/split_test.$$
+trap 'rm -rf $dir; trap 0; exit' 0 1 2 3 15
+mkdir $dir
+
+awk 'BEGIN {
+    srand(1)
+    for (i = 0; i < 1000; i++) {
+        if (i % 251 == 0)
+            printf "%05000d\n", i
+        else
+            printf "%0*d\n", int(rand() * 200), i
+    }
+    printf "last line"
+}' > $dir/in
+
+check()         # start offset, bufsz, then -l or -C option
+{
+    start=$1
+    bufsz=$2
+    shift 2
+    rm -f $dir/ref* $dir/piece*
+    tail -c +$((start + 1)) $dir/in > $dir/expect
+    (cd $dir && split -d -a 3 "$@" expect ref)
+    for append in "" -a
+    do
+        rm -f $dir/piece*
+        if ! rawsplit_test -s $start -b $bufsz $append "$@" $dir/in $dir/piece ||
+           ! cat $dir/piece* | cmp -s - $dir/expect
+        then
+            echo FAILED: rawsplit_test -s $start -b $bufsz $append "$@"
+            exit 1
+        fi
+        for ref in $dir/ref*
+        do
+            if ! cmp -s $ref $dir/piece${ref#$dir/ref}
+            then
+                echo FAILED: rawsplit_test -s $start -b $bufsz $append "$@": \
+                        piece${ref#$dir/ref} differs from split
+                exit 1
+            fi
+        done
+        if test $(ls $dir/piece* | wc -l) != $(ls $dir/ref* | wc -l)
+        then
+            echo FAILED: rawsplit_test -s $start -b $bufsz $append "$@": piece count
+            exit 1
+        fi
+    done
+}
+
+for start in 0 1234
+do
+    for nlines in 30 100 1000 5000
+    do
+        for bufsz in 16 256 65536
+        do
+            check $start $bufsz -l $nlines
+            if ls $dir/piece* | sed '$d' | xargs -r wc -l |
+                    grep -v ' total$' | grep -v "^ *$nlines "
+            then
+                echo FAILED: rawsplit_test -s $start -b $bufsz -l $nlines: \
+                        piece line count
+                exit 1
+            fi
+        done
+    done
+    for nbytes in 1000 4096 100000
+    do
+        check $start 64 -C $nbytes
+    done
+done
+
+echo split_test: passed
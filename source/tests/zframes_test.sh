@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Check rawzframes_test (rs_open_zframes()) against gzip -dc and
+# zstd -dc, for buffer sizes from smaller than most lines on up, and
+# for one or more decompression threads.  zframes_test.bgz is BGZF,
+# in 997 byte blocks, so that lines, and a 3000 byte line, span
+# blocks, and its last line lacks a final newline.  Also check
+# ordinary, one and two member, gzip input, uncompressed input, and,
+# where zstd is installed and rawscan was built with libzstd, zstd
+# input of several frames.
+
+PATH=.:$PATH
+tmp=/tmp/zframes_test.$$
+trap 'rm -f $tmp.*; trap 0; exit' 0 1 2 3 15
+
+gzip -dc < zframes_test.bgz > $tmp.plain
+head -c 5000 $tmp.plain > $tmp.1
+tail -c +5001 $tmp.plain > $tmp.2
+gzip -c < $tmp.plain > $tmp.gz
+(gzip -c < $tmp.1; gzip -c < $tmp.2) > $tmp.gz2
+
+check()         # input, then rawzframes_test options
+{
+    input=$1
+    shift
+    if ! rawzframes_test "$@" < $input | cmp -s - $tmp.plain
+    then
+        echo FAILED: rawzframes_test "$@" \< $input
+        exit 1
+    fi
+}
+
+for bufsz in 4 16 64 1024 65536
+do
+    for nthreads in 1 2 4
+    do
+        check zframes_test.bgz -b $bufsz -t $nthreads
+    done
+    check $tmp.gz -b $bufsz
+    check $tmp.gz2 -b $bufsz
+    check $tmp.plain -b $bufsz
+done
+
+if command -v zstd > /dev/null
+then
+    (zstd -q -c < $tmp.1; zstd -q -c < $tmp.2) > $tmp.zst
+    rawzframes_test < $tmp.zst > /dev/null 2>&1
+    if test $? -eq 2
+    then
+        echo zframes_test: rawscan built without libzstd: zstd not tested
+    else
+        for bufsz in 4 16 64 1024 65536
+        do
+            for nthreads in 1 2 4
+            do
+                check $tmp.zst -b $bufsz -t $nthreads
+            done
+        done
+    fi
+fi
+
+echo zframes_test: passed